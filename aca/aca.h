@@ -20,6 +20,8 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #define AC__AC_H
 // use this line to print debugging information from C++ code
 // #define ACA_DEBUG    1
+// use this line to collect the hot path counters of CppAutomaton::get_stats
+// #define ACA_STATS    1
 #define BEGIN_NAMESPACE(x)  namespace x {
 #define END_NAMESPACE }
 
@@ -28,20 +30,53 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <map>
 #include <utility>
 #include <memory>
+#include <cstdint>
 
 BEGIN_NAMESPACE(aca)
 
+// how overlapping matches are resolved
+enum CppMatchKind {
+    // all the matches, overlapping ones included
+    MATCH_ALL = 0,
+    // the non-overlapping matches chosen by cpp_remove_overlaps
+    MATCH_NO_OVERLAPS = 1,
+    // scanning from the left, the match starting first and of those the longest one
+    MATCH_LEFTMOST_LONGEST = 2,
+    // scanning from the left, the match starting first and of those the pattern added first
+    MATCH_LEFTMOST_FIRST = 3
+};
+
 // forward declare our classes
 class CppNode;
 class CppMatch;
+class CppSymbolTable;
+class CppMatcherState;
 class CppAutomaton;
 
 // create some useful type definitions
-typedef std::shared_ptr<CppNode> NodePtr;
 typedef std::vector<CppMatch> MatchVector;
 typedef std::vector<std::string> StringVector;
 typedef std::vector<int> IntVector;
-typedef std::vector<NodePtr> NodeVector;
+
+// nodes are stored in a contiguous arena and referred to by their index
+typedef int32_t NodeId;
+typedef std::vector<CppNode> NodeVector;
+// id of a node that does not exist
+const NodeId NO_NODE = -1;
+
+// interned tokens are referred to by dense 32-bit ids
+typedef uint32_t SymbolId;
+typedef std::vector<SymbolId> SymbolVector;
+// id of a token that is not in the symbol table
+const SymbolId NO_SYMBOL = static_cast<SymbolId>(-1);
+
+// values of patterns are interned to label ids, the empty value of
+// non-terminal nodes is always NO_LABEL
+typedef uint32_t LabelId;
+const LabelId NO_LABEL = 0;
+
+// multi-dictionary automata store a value for each dictionary id of a pattern, see CppDictionaryIndex
+typedef uint32_t DictId;
 
 // type used to return all the keys/values in the automaton
 typedef std::pair<StringVector, std::string> KeyValue;
@@ -1,5 +1,5 @@
 # distutils: language = c++
-# distutils: sources = aca/match.cpp aca/node.cpp aca/automaton.cpp
+# distutils: sources = aca/match.cpp aca/node.cpp aca/symbols.cpp aca/flat.cpp aca/mapped.cpp aca/dfa.cpp aca/casefold.cpp aca/prefilter.cpp aca/doublearray.cpp aca/dictionaries.cpp aca/automaton.cpp
 # -*- coding: utf-8 -*-
 #from __future__ import unicode_literals, print_function, absolute_import
 
@@ -8,38 +8,132 @@ from libcpp cimport bool
 from libcpp.string cimport string
 from libcpp.vector cimport vector
 from libcpp.utility cimport pair
+from libcpp.map cimport map as cppmap
+from libc.stdint cimport uint32_t, uint64_t
+from cpython.buffer cimport PyBUF_WRITABLE, PyBUF_FORMAT, PyBUF_ND, PyBUF_STRIDES, PyBUF_F_CONTIGUOUS
 import unicodedata
 
 cdef extern from "all.h" namespace "aca":
+    cdef enum CppCaseFold:
+        CASE_FOLD_NONE
+        CASE_FOLD_ASCII
+        CASE_FOLD_UNICODE
+
+    cdef enum CppMatchKind:
+        MATCH_ALL
+        MATCH_NO_OVERLAPS
+        MATCH_LEFTMOST_LONGEST
+        MATCH_LEFTMOST_FIRST
+
     cdef cppclass CppMatch:
         CppMatch() except +
-        CppMatch(int, int, string) except +
-        CppMatch(int, int, char*) except +
+        CppMatch(int, int, uint32_t) except +
         void set_start(int)
         void set_end(int)
-        void set_label(string)
+        void set_label(uint32_t)
         int get_start()
         int get_end()
-        string get_label()
+        uint32_t get_label()
         int is_before(const CppMatch&)
         size_t size()
 
     cdef vector[CppMatch] cpp_remove_overlaps(vector[CppMatch]);
 
+    cdef cppclass CppMatcherState:
+        CppMatcherState() except +
+        long get_offset()
+        void reset()
+
+    cdef cppclass CppMatchCursor:
+        CppMatchCursor() except +
+        long get_offset()
+        void reset()
+
+    cdef cppclass CppTrieCursor:
+        CppTrieCursor() except +
+        bool done()
+
+    cdef cppclass CppDictionaryIndex:
+        @staticmethod
+        vector[pair[uint32_t, string]] decode(string) except +
+
+    cdef cppclass CppStats:
+        size_t num_nodes
+        size_t num_patterns
+        size_t max_depth
+        size_t output_links
+        cppmap[size_t, size_t] fanout
+        cppmap[string, size_t] memory
+        string prefilter
+        cppmap[string, uint64_t] counters
+
     cdef cppclass CppAutomaton:
-        Automaton() except +
-        void add(vector[string]&, string)
+        CppAutomaton() except +
+        CppAutomaton(bool) except +
+        CppAutomaton(bool, CppCaseFold) except +
+        CppAutomaton(bool, CppCaseFold, bool) except +
+        bool is_byte_mode()
+        CppCaseFold get_case_fold()
+        bool is_nfc()
+        void set_nfc(bool)
+        bool is_multi_dictionary()
+        void add(vector[string]&, string) except +
+        bool remove(vector[string]&) except +
+        void add_entry(vector[string]&, uint32_t, string) except +
+        bool remove_entry(vector[string]&, uint32_t) except +
+        size_t num_dictionaries()
+        void compact()
         void update_automaton()
+        void build_from(vector[pair[vector[string], string]]&, unsigned) except + nogil
+        void compile()
+        bool is_compiled()
+        bool is_read_only()
         bool has_pattern(vector[string]&)
         bool has_prefix(vector[string]&)
+        bool has_prefix_bytes(const char*, size_t) except +
         string get_value(vector[string]&)
-        vector[CppMatch] get_matches(vector[string]&, bool)
+        uint32_t find_label(vector[string]&)
+        uint32_t find_label_bytes(const char*, size_t) except +
+        void build_lookup()
+        bool has_lookup()
+        string get_label_string "get_label"(uint32_t)
+        size_t num_labels()
+        CppStats get_stats()
+        void reset_counters()
+        vector[uint32_t] encode_symbols(vector[string]&)
+        vector[CppMatch] get_matches(vector[string]&, CppMatchKind, size_t)
+        vector[CppMatch] get_matches_symbols "get_matches"(vector[uint32_t]&, CppMatchKind, size_t)
+        vector[CppMatch] get_matches_bytes(const char*, size_t, CppMatchKind, bool, size_t) except +
+        vector[CppMatch] get_matches_dicts(vector[string]&, vector[bool]&, CppMatchKind, vector[int]&, size_t) except +
+        vector[CppMatch] get_matches_dicts_bytes(const char*, size_t, vector[bool]&, CppMatchKind, bool, vector[int]&,
+                                                 size_t) except +
+        string get_entry_value(uint32_t)
+        vector[CppMatch] next_matches(CppMatchCursor&, vector[uint32_t]&, CppMatchKind, size_t) except +
+        vector[CppMatch] next_matches_bytes(CppMatchCursor&, const char*, size_t, CppMatchKind, size_t, bool) except +
+        vector[vector[CppMatch]] get_matches_batch(vector[vector[string]]&, CppMatchKind, unsigned) except + nogil
+        vector[vector[CppMatch]] get_matches_bytes_batch(vector[string]&, CppMatchKind, bool, unsigned) except + nogil
+        bool contains_any(vector[string]&)
+        bool contains_any_bytes(const char*, size_t) except +
+        size_t count_matches(vector[string]&, bool)
+        size_t count_matches_bytes(const char*, size_t, bool) except +
+        cppmap[string, size_t] count_by_label(vector[string]&, bool)
+        cppmap[string, size_t] count_by_label_bytes(const char*, size_t, bool) except +
+        vector[CppMatch] feed(CppMatcherState&, vector[string]&)
+        vector[CppMatch] feed_bytes(CppMatcherState&, const char*, size_t) except +
         vector[pair[vector[string], string]] get_patterns_values()
         vector[pair[vector[string], string]] get_prefixes_values()
+        void start_items(CppTrieCursor&, vector[string]&, bool, size_t, size_t)
+        vector[pair[vector[string], string]] next_items(CppTrieCursor&, size_t)
 
         # serialization related
-        string serialize()
+        string serialize() except +
         void serialize_to (string) except +
+        void save_mapped(string) except +
+        uint64_t content_hash()
+        string serialize_delta(CppAutomaton&) except +
+        void serialize_delta_to(CppAutomaton&, string) except +
+        size_t apply_delta(string) except +
+        size_t apply_delta_from(string) except +
 
         @staticmethod
         CppAutomaton* deserialize(string)
@@ -47,6 +141,9 @@ cdef extern from "all.h" namespace "aca":
         @staticmethod
         CppAutomaton* deserialize_from(string) except +
 
+        @staticmethod
+        CppAutomaton* open_mapped(string) except +
+
         string str()
 
 
@@ -69,18 +166,57 @@ def encode_list(lst):
 def decode_list(lst):
     return [decode(e) for e in lst]
 
+def encode_bytes(text):
+    """ Get the UTF-8 bytes of a text for byte mode, the tokens of a list are joined.
+    Byte mode matches the bytes as they are, so the text is not normalized. """
+    if isinstance(text, six.binary_type):
+        return text
+    if isinstance(text, six.string_types):
+        return text.encode('utf-8')
+    return b''.join(encode_bytes(e) for e in text)
+
+
+# the ways of folding case, see Automaton
+CASE_FOLDS = {
+    None: CASE_FOLD_NONE,
+    'ascii': CASE_FOLD_ASCII,
+    'unicode': CASE_FOLD_UNICODE
+}
+
+# the ways of resolving overlapping matches, see Automaton.get_matches
+MATCH_KINDS = {
+    'all': MATCH_ALL,
+    'no_overlaps': MATCH_NO_OVERLAPS,
+    'leftmost_longest': MATCH_LEFTMOST_LONGEST,
+    'leftmost_first': MATCH_LEFTMOST_FIRST
+}
+
+# the number of tokens, or bytes in byte mode, that iter_matches scans at a time
+ITER_BATCH = 4096
+# the number of patterns Automaton.items and prefixes get from the automaton at a time
+ITEMS_BATCH = 256
+
+cdef CppMatchKind to_match_kind(exclude_overlaps, match_kind) except *:
+    if match_kind is None:
+        return MATCH_NO_OVERLAPS if exclude_overlaps else MATCH_ALL
+    if match_kind not in MATCH_KINDS:
+        raise ValueError('Unknown match kind {!r}, expected one of {}'.format(match_kind, sorted(MATCH_KINDS)))
+    return MATCH_KINDS[match_kind]
+
 
 class Match:
 
-    def __init__(self, start, end, label='Y'):
+    def __init__(self, start, end, label='Y', dictionary=None):
         self.__start = int(start)
         self.__end = int(end)
         assert self.__start < self.__end
         self.__label = str(label)
+        self.__dictionary = dictionary
         self.__elems = None
 
     def __eq__(self, other):
-        return self.start == other.start and self.end == other.end and self.label == other.label
+        return self.start == other.start and self.end == other.end and self.label == other.label and \
+            self.dictionary == other.dictionary
 
     def __str__(self):
         return 'Match({},{},{},{})'.format(self.start, self.end, self.elems, self.label)
@@ -100,6 +236,11 @@ class Match:
     def label(self):
         return self.__label
 
+    @property
+    def dictionary(self):
+        """ The id of the dictionary the match was found in, None unless the automaton has dictionaries. """
+        return self.__dictionary
+
     @property
     def elems(self):
         return self.__elems
@@ -108,53 +249,169 @@ class Match:
         self.__elems = elems
 
 
+cdef vector[bool] active_dictionaries(dictionaries, size_t count) except *:
+    """ Get the flags of the dictionaries given as an iterable of ids or a bitmask, all of them for None. """
+    cdef vector[bool] active
+    if dictionaries is None:
+        active.assign(count, True)
+    elif isinstance(dictionaries, six.integer_types):
+        active.assign(dictionaries.bit_length(), False)
+        for dict_id in range(active.size()):
+            active[dict_id] = (dictionaries >> dict_id) & 1 == 1
+    else:
+        for dict_id in dictionaries:
+            if dict_id < 0:
+                raise ValueError('Dictionary ids can not be negative')
+            if dict_id >= active.size():
+                active.resize(dict_id + 1, False)
+            active[dict_id] = True
+    return active
+
+
 cdef vector[CppMatch] matches_to_cppmatches(matches):
+    # the label of a CppMatch is the index of the match, so that the matches can be found again
     cdef vector[CppMatch] vec
     cdef CppMatch cppmatch;
     vec.reserve(len(matches))
-    for match in matches:
+    for idx, match in enumerate(matches):
         cppmatch.set_start(match.start)
         cppmatch.set_end(match.end)
-        cppmatch.set_label(encode(match.label))
+        cppmatch.set_label(idx)
         vec.push_back(cppmatch)
     return vec
 
-cdef cppmatches_to_matches(vector[CppMatch] cppmatches):
-    result = [None]*cppmatches.size()
-    for i in range(cppmatches.size()):
-        result[i] = Match(cppmatches[i].get_start(), cppmatches[i].get_end(), decode(cppmatches[i].get_label()))
-    return result
-
 def remove_overlaps(matches):
     cdef vector[CppMatch] cppmatches;
     cdef vector[CppMatch] cppresult;
+    matches = list(matches)
     cppmatches = matches_to_cppmatches(matches)
     cppresult = cpp_remove_overlaps(cppmatches)
-    return cppmatches_to_matches(cppresult)
+    return [matches[cppresult[i].get_label()] for i in range(cppresult.size())]
 
 
 cdef class Automaton:
     """ Aho-Corasick keyword tree + automaton. """
     cdef CppAutomaton* cpp_automaton
-
-    def __cinit__(self):
-        self.cpp_automaton = new CppAutomaton()
+    # incremented whenever cpp_automaton is replaced or nodes are removed, so that matchers notice it
+    cdef long generation
+    # decoded labels by label id, label ids only change when cpp_automaton is replaced or compacted.
+    # The labels of a multi-dictionary automaton are sets of dictionaries that change in place.
+    cdef dict label_cache
+    # decoded values of the dictionaries by entry id, as label_cache
+    cdef dict entry_cache
+
+    def __cinit__(self, *args, byte_mode=False, case_fold=None, nfc=True, multi_dictionary=False, **kwargs):
+        """ In byte mode the automaton works on the UTF-8 bytes of plain strings instead of tokens,
+        which is much faster for matching untokenized text.
+        With case_fold set to 'ascii' or 'unicode' (simple case folding) the patterns and the texts
+        are matched case-insensitively. The texts are folded on the fly, so the positions of the
+        matches refer to the original text. In byte mode, the few code points whose folded form has
+        another UTF-8 length are not folded.
+        Tokens are normalized to NFC in token mode, unless nfc is False.
+        A multi_dictionary automaton holds many dictionaries that share the patterns they have in
+        common, a pattern has a value in each dictionary it is added to, see add and get_matches. """
+        if case_fold not in CASE_FOLDS:
+            raise ValueError('Unknown case fold {!r}, expected one of None, \'ascii\' or \'unicode\''.format(case_fold))
+        self.cpp_automaton = new CppAutomaton(<bool>byte_mode, <CppCaseFold>CASE_FOLDS[case_fold],
+                                              <bool>multi_dictionary)
+        self.cpp_automaton.set_nfc(nfc)
+        self.generation = 0
+        self.label_cache = {}
+        self.entry_cache = {}
 
     def __dealloc__(self):
         del self.cpp_automaton
 
-    def load_from_file(self, fnm):
-        cdef CppAutomaton* new_cpp_automaton = self.cpp_automaton.deserialize_from(encode(fnm))
+    cdef replace_cpp_automaton(self, CppAutomaton* new_cpp_automaton):
         del self.cpp_automaton
         self.cpp_automaton = new_cpp_automaton
+        self.generation += 1
+        self.label_cache = {}
+        self.entry_cache = {}
+
+    cdef object decode_value(self, string value):
+        """ Decode a value, which is a dict from dictionary ids to values in a multi-dictionary automaton. """
+        if self.cpp_automaton.is_multi_dictionary() and not value.empty():
+            return dict((entry.first, decode(entry.second)) for entry in CppDictionaryIndex.decode(value))
+        return decode(value)
+
+    cdef object label_of(self, uint32_t label_id):
+        label = self.label_cache.get(label_id)
+        if label is None:
+            label = self.decode_value(self.cpp_automaton.get_label_string(label_id))
+            self.label_cache[label_id] = label
+        if isinstance(label, dict):
+            return dict(label) # the cached one must not change
+        return label
+
+    cdef object entry_value_of(self, uint32_t entry_id):
+        value = self.entry_cache.get(entry_id)
+        if value is None:
+            value = decode(self.cpp_automaton.get_entry_value(entry_id))
+            self.entry_cache[entry_id] = value
+        return value
 
-    def load_from_string(self, binstring):
-        cdef CppAutomaton* new_cpp_automaton = self.cpp_automaton.deserialize(binstring)
-        del self.cpp_automaton
-        self.cpp_automaton = new_cpp_automaton
+    cdef list cppmatches_to_matches(self, vector[CppMatch] cppmatches):
+        result = [None]*cppmatches.size()
+        for i in range(cppmatches.size()):
+            result[i] = Match(cppmatches[i].get_start(), cppmatches[i].get_end(),
+                              self.label_of(cppmatches[i].get_label()))
+        return result
 
-    def add(self, pattern, value='Y'):
-        self.cpp_automaton.add(encode_list(pattern), encode(value))
+    cdef uint32_t find_label(self, pattern) except? 0:
+        cdef bytes data
+        if self.cpp_automaton.is_byte_mode():
+            data = encode_bytes(pattern)
+            return self.cpp_automaton.find_label_bytes(data, len(data))
+        return self.cpp_automaton.find_label(self.encode_tokens(pattern))
+
+    def load_from_file(self, fnm):
+        self.replace_cpp_automaton(self.cpp_automaton.deserialize_from(encode(fnm)))
+
+    def load_from_string(self, binstring):
+        self.replace_cpp_automaton(self.cpp_automaton.deserialize(binstring))
+
+    def load_mmap(self, fnm):
+        """ Use an automaton saved with save_mmap straight from the file without loading it.
+        The automaton becomes read-only and its memory is shared with every process that maps the same file. """
+        self.replace_cpp_automaton(self.cpp_automaton.open_mapped(encode(fnm)))
+
+    def encode_pattern(self, pattern):
+        if self.cpp_automaton.is_byte_mode():
+            data = encode_bytes(pattern)
+            return [data[i:i+1] for i in range(len(data))]
+        return self.encode_tokens(pattern)
+
+    def encode_tokens(self, tokens):
+        """ Get the UTF-8 bytes of the tokens, normalized to NFC unless the automaton was created with nfc=False. """
+        if self.cpp_automaton.is_nfc():
+            return encode_list(tokens)
+        return [encode_bytes(token) for token in tokens]
+
+    def decode_pattern(self, tokens):
+        if self.cpp_automaton.is_byte_mode():
+            return b''.join(tokens).decode('utf-8')
+        return decode_list(tokens)
+
+    def is_byte_mode(self):
+        return self.cpp_automaton.is_byte_mode()
+
+    def case_fold(self):
+        """ Get the case folding of the automaton, None, 'ascii' or 'unicode'. """
+        fold = self.cpp_automaton.get_case_fold()
+        return next(name for name, value in CASE_FOLDS.items() if value == fold)
+
+    def add(self, pattern, value='Y', dictionary=None):
+        """ Add a pattern with a value, in a multi-dictionary automaton to the dictionary with the given id. """
+        if self.cpp_automaton.is_multi_dictionary():
+            if dictionary is None:
+                raise ValueError('The dictionary of the pattern must be given in a multi-dictionary automaton')
+            self.cpp_automaton.add_entry(self.encode_pattern(pattern), dictionary, encode(value))
+            self.label_cache = {}
+        elif dictionary is not None:
+            raise ValueError('The automaton has no dictionaries, create it with multi_dictionary=True')
+        else:
+            self.cpp_automaton.add(self.encode_pattern(pattern), encode(value))
 
     def add_all(self, patterns):
         for pattern in patterns:
@@ -164,31 +421,329 @@ cdef class Automaton:
             else:
                 self.add(pattern)
 
+    def remove(self, pattern, dictionary=None):
+        """ Remove a pattern and the nodes that no longer lead to any pattern.
+        Returns False if the automaton does not contain the pattern. If a dictionary is given,
+        the pattern is only removed from that dictionary of a multi-dictionary automaton. """
+        if dictionary is not None:
+            removed = self.cpp_automaton.remove_entry(self.encode_pattern(pattern), dictionary)
+            self.label_cache = {}
+        else:
+            removed = self.cpp_automaton.remove(self.encode_pattern(pattern))
+        if removed:
+            self.generation += 1
+        return removed
+
+    def compact(self):
+        """ Free the memory of the nodes pruned by removing patterns, and of the values that were
+        replaced or removed. The label ids change, so the label ids of the match arrays got before
+        compact() are no longer valid, call labels() again for the new ones. """
+        self.cpp_automaton.compact()
+        self.generation += 1
+        self.label_cache = {}
+        self.entry_cache = {}
+
+    def build(self, patterns, num_threads=0):
+        """ Add many patterns at once, given as in add_all, and update the automaton.
+        The work is done on num_threads threads without holding the GIL, 0 means one thread per core. """
+        cdef vector[pair[vector[string], string]] items
+        cdef pair[vector[string], string] item
+        cdef unsigned nthreads = num_threads
+        for pattern in patterns:
+            value = 'Y'
+            if isinstance(pattern, tuple):
+                pattern, value = pattern
+            item.first = self.encode_pattern(pattern)
+            item.second = encode(value)
+            items.push_back(item)
+        with nogil:
+            self.cpp_automaton.build_from(items, nthreads)
+
     def update_automaton(self):
         self.cpp_automaton.update_automaton()
 
+    def compile(self):
+        """ Compile the automaton into a deterministic automaton for faster matching.
+        The compiled form is discarded when new patterns are added. """
+        self.cpp_automaton.compile()
+
+    def is_compiled(self):
+        return self.cpp_automaton.is_compiled()
+
+    def is_read_only(self):
+        return self.cpp_automaton.is_read_only()
+
     def has_pattern(self, pattern):
-        return self.cpp_automaton.has_pattern(encode_list(pattern))
+        return self.find_label(pattern) != 0
 
     def has_prefix(self, prefix):
-        return self.cpp_automaton.has_prefix(encode_list(prefix))
+        cdef bytes data
+        if self.cpp_automaton.is_byte_mode():
+            data = encode_bytes(prefix)
+            return self.cpp_automaton.has_prefix_bytes(data, len(data))
+        return self.cpp_automaton.has_prefix(self.encode_tokens(prefix))
+
+    def build_lookup(self):
+        """ Build a double-array trie that speeds up the dictionary lookups, i.e. getting values,
+        has_pattern and has_prefix, and takes much less memory than the keyword tree.
+        It is used until the automaton is modified, call build_lookup again after that. """
+        self.cpp_automaton.build_lookup()
+
+    def has_lookup(self):
+        return self.cpp_automaton.has_lookup()
+
+    def get_matches(self, text, exclude_overlaps=True, match_kind=None, max_matches=None, dictionaries=None):
+        """ Find the patterns in the text. Overlapping matches are resolved as given by match_kind:
+        'all' keeps them, 'no_overlaps' chooses the best non-overlapping ones with remove_overlaps,
+        'leftmost_longest' and 'leftmost_first' take the match that starts first, and of those
+        starting at the same position the longest one or the one whose pattern was added first.
+        The leftmost kinds need constant extra memory, but the text after a match is scanned again
+        up to the length of the longest pattern, see README. If match_kind is not given,
+        exclude_overlaps chooses between 'no_overlaps' and 'all'. If max_matches is given, matching
+        stops after that many matches, the overlaps are removed from the matches found until then.
+        In a multi-dictionary automaton, see get_matches_dicts. """
+        cdef CppMatchKind kind = to_match_kind(exclude_overlaps, match_kind)
+        if self.cpp_automaton.is_multi_dictionary() or dictionaries is not None:
+            return self.get_matches_dicts(text, kind, max_matches or 0, dictionaries)
+        if self.cpp_automaton.is_byte_mode():
+            return self.get_matches_bytes(text, kind, max_matches or 0)
+        matches = self.cpp_automaton.get_matches(self.encode_tokens(text), kind, max_matches or 0)
+        results = self.cppmatches_to_matches(matches)
+        for match in results:
+            match.set_elems(text[match.start:match.end])
+        return results
 
-    def get_matches(self, text, exclude_overlaps=True):
-        matches = self.cpp_automaton.get_matches(encode_list(text), exclude_overlaps)
-        results = cppmatches_to_matches(matches)
+    def get_matches_bytes(self, text, CppMatchKind kind, size_t max_matches=0):
+        cdef bytes data = encode_bytes(text)
+        # positions are bytes for a bytes text and characters otherwise
+        utf8_offsets = not isinstance(text, six.binary_type)
+        if utf8_offsets and not isinstance(text, six.string_types):
+            text = data.decode('utf-8')
+        results = self.cppmatches_to_matches(self.cpp_automaton.get_matches_bytes(data, len(data), kind, utf8_offsets,
+                                                                                  max_matches))
         for match in results:
             match.set_elems(text[match.start:match.end])
         return results
 
-    def items(self):
-        cdef vector[pair[vector[string], string]] vec = self.cpp_automaton.get_patterns_values()
-        for idx in range(vec.size()):
-            yield decode_list(vec[idx].first), decode(vec[idx].second)
+    def get_matches_dicts(self, text, CppMatchKind kind, size_t max_matches, dictionaries):
+        """ Find the patterns of the dictionaries given by their ids, or by a bitmask of them, in a
+        single pass over the text, all the dictionaries if dictionaries is None. The match of a
+        pattern in many of them is reported for each, with the dictionary id as match.dictionary.
+        The overlaps are removed within each dictionary, the leftmost match kinds are not supported. """
+        cdef bytes data
+        cdef vector[CppMatch] cppmatches
+        cdef vector[int] dicts
+        if not self.cpp_automaton.is_multi_dictionary():
+            raise ValueError('The automaton has no dictionaries, create it with multi_dictionary=True')
+        if kind != MATCH_ALL and kind != MATCH_NO_OVERLAPS:
+            raise ValueError('Only the match kinds \'all\' and \'no_overlaps\' are supported with dictionaries')
+        cdef vector[bool] active = active_dictionaries(dictionaries, self.cpp_automaton.num_dictionaries())
+        if self.cpp_automaton.is_byte_mode():
+            data = encode_bytes(text)
+            utf8_offsets = not isinstance(text, six.binary_type)
+            if utf8_offsets and not isinstance(text, six.string_types):
+                text = data.decode('utf-8')
+            cppmatches = self.cpp_automaton.get_matches_dicts_bytes(data, len(data), active, kind, utf8_offsets, dicts,
+                                                                    max_matches)
+        else:
+            cppmatches = self.cpp_automaton.get_matches_dicts(self.encode_tokens(text), active, kind, dicts, max_matches)
+        results = [None]*cppmatches.size()
+        for i in range(cppmatches.size()):
+            match = Match(cppmatches[i].get_start(), cppmatches[i].get_end(),
+                          self.entry_value_of(cppmatches[i].get_label()), dicts[i])
+            match.set_elems(text[match.start:match.end])
+            results[i] = match
+        return results
 
-    def prefixes(self):
-        cdef vector[pair[vector[string], string]] vec = self.cpp_automaton.get_prefixes_values()
-        for idx in range(vec.size()):
-            yield decode_list(vec[idx].first), decode(vec[idx].second)
+    def num_dictionaries(self):
+        """ Get one more than the largest dictionary id of a multi-dictionary automaton. """
+        return self.cpp_automaton.num_dictionaries()
+
+    def is_multi_dictionary(self):
+        return self.cpp_automaton.is_multi_dictionary()
+
+    def get_matches_batch(self, texts, exclude_overlaps=True, num_threads=0, match_kind=None, dictionaries=None):
+        """ Match many texts in parallel and get the list of matches of each text.
+        The matching runs on num_threads threads without holding the GIL, 0 means one thread per core.
+        The texts are matched one by one with get_matches_dicts in a multi-dictionary automaton. """
+        cdef vector[vector[string]] cpptexts
+        cdef vector[string] cppdata
+        cdef vector[vector[CppMatch]] cppresults
+        cdef CppMatchKind kind = to_match_kind(exclude_overlaps, match_kind)
+        cdef bool utf8_offsets = True
+        cdef unsigned nthreads = num_threads
+        texts = list(texts)
+        if self.cpp_automaton.is_multi_dictionary() or dictionaries is not None:
+            return [self.get_matches_dicts(text, kind, 0, dictionaries) for text in texts]
+        if self.cpp_automaton.is_byte_mode():
+            cppdata.reserve(len(texts))
+            for idx in range(len(texts)):
+                cppdata.push_back(encode_bytes(texts[idx]))
+                if isinstance(texts[idx], six.binary_type):
+                    utf8_offsets = False
+                elif not isinstance(texts[idx], six.string_types):
+                    texts[idx] = encode_bytes(texts[idx]).decode('utf-8')
+            if not utf8_offsets and not all(isinstance(text, six.binary_type) for text in texts):
+                raise TypeError('A batch can not mix bytes and strings in byte mode')
+            with nogil:
+                cppresults = self.cpp_automaton.get_matches_bytes_batch(cppdata, kind, utf8_offsets, nthreads)
+        else:
+            cpptexts.reserve(len(texts))
+            for text in texts:
+                cpptexts.push_back(self.encode_tokens(text))
+            with nogil:
+                cppresults = self.cpp_automaton.get_matches_batch(cpptexts, kind, nthreads)
+        results = [None]*len(texts)
+        for idx in range(len(texts)):
+            results[idx] = self.cppmatches_to_matches(cppresults[idx])
+            for match in results[idx]:
+                match.set_elems(texts[idx][match.start:match.end])
+        return results
+
+    def contains_any(self, text):
+        """ Check if the text contains any of the patterns, the scan stops at the first match. """
+        cdef bytes data
+        if self.cpp_automaton.is_byte_mode():
+            data = encode_bytes(text)
+            return self.cpp_automaton.contains_any_bytes(data, len(data))
+        return self.cpp_automaton.contains_any(self.encode_tokens(text))
+
+    def count_matches(self, text, exclude_overlaps=False, dictionaries=None):
+        """ Count the matches in the text without creating them.
+        Excluding the overlaps needs the matches, so it is as slow as get_matches.
+        The matches of a multi-dictionary automaton are counted as get_matches_dicts gives them. """
+        cdef bytes data
+        if self.cpp_automaton.is_multi_dictionary() or dictionaries is not None:
+            return len(self.get_matches_dicts(text, to_match_kind(exclude_overlaps, None), 0, dictionaries))
+        if self.cpp_automaton.is_byte_mode():
+            data = encode_bytes(text)
+            return self.cpp_automaton.count_matches_bytes(data, len(data), exclude_overlaps)
+        return self.cpp_automaton.count_matches(self.encode_tokens(text), exclude_overlaps)
+
+    def count_by_label(self, text, exclude_overlaps=False):
+        """ Count the matches in the text by their labels, returns a dict of label: count.
+        Not supported in a multi-dictionary automaton, whose labels are sets of dictionaries. """
+        cdef bytes data
+        cdef cppmap[string, size_t] counts
+        if self.cpp_automaton.is_multi_dictionary():
+            raise ValueError('Counting by label is not supported with dictionaries, count the matches of get_matches')
+        if self.cpp_automaton.is_byte_mode():
+            data = encode_bytes(text)
+            counts = self.cpp_automaton.count_by_label_bytes(data, len(data), exclude_overlaps)
+        else:
+            counts = self.cpp_automaton.count_by_label(self.encode_tokens(text), exclude_overlaps)
+        return {decode(item.first): item.second for item in counts}
+
+    def get_matches_array(self, text, exclude_overlaps=True, match_kind=None, max_matches=None):
+        """ Get the matches as a MatchArray, which shares the memory of the C++ matches through
+        the buffer protocol as an int32 array with one (start, end, label id) row per match.
+        Use labels() to translate the label ids. max_matches is the same as in get_matches.
+        Not supported in a multi-dictionary automaton, as the rows have no dictionary. """
+        cdef bytes data
+        cdef MatchArray result = MatchArray()
+        cdef CppMatchKind kind = to_match_kind(exclude_overlaps, match_kind)
+        if self.cpp_automaton.is_multi_dictionary():
+            raise ValueError('Match arrays are not supported with dictionaries, use get_matches')
+        if self.cpp_automaton.is_byte_mode():
+            data = encode_bytes(text)
+            result.matches = self.cpp_automaton.get_matches_bytes(data, len(data), kind,
+                                                                  not isinstance(text, six.binary_type),
+                                                                  max_matches or 0)
+        else:
+            result.matches = self.cpp_automaton.get_matches(self.encode_tokens(text), kind, max_matches or 0)
+        return result
+
+    def labels(self):
+        """ Get the list of labels, the label id of a match is its index in the list.
+        The labels of a multi-dictionary automaton are dicts from dictionary ids to values, as the values of items. """
+        return [self.decode_value(self.cpp_automaton.get_label_string(label_id))
+                for label_id in range(self.cpp_automaton.num_labels())]
+
+    def stats(self):
+        """ Get statistics of the automaton as a dict: the number of reachable nodes and patterns,
+        the maximum depth, the total length of the output lists (0 before the first update),
+        a fanout histogram of number of children: number of nodes, the approximate bytes used
+        by each component, the kernel that searches the texts for positions where a match can
+        start and the hot path counters. The counters are only collected when
+        the extension is built with the ACA_STATS environment variable set, otherwise
+        the counters dict is empty. """
+        cdef CppStats cppstats = self.cpp_automaton.get_stats()
+        return {
+            'nodes': cppstats.num_nodes,
+            'patterns': cppstats.num_patterns,
+            'max_depth': cppstats.max_depth,
+            'output_links': cppstats.output_links,
+            'fanout': {item.first: item.second for item in cppstats.fanout},
+            'memory': {decode(item.first): item.second for item in cppstats.memory},
+            'prefilter': decode(cppstats.prefilter),
+            'counters': {decode(item.first): item.second for item in cppstats.counters}
+        }
+
+    def reset_counters(self):
+        """ Set the hot path counters of stats() to zero. """
+        self.cpp_automaton.reset_counters()
+
+    def encode_symbols(self, text):
+        """ Translate the tokens of a text to the integer symbol ids used by the automaton.
+        Tokens that do not occur in any pattern are mapped to the same "unknown" id. """
+        return self.cpp_automaton.encode_symbols(self.encode_tokens(text))
+
+    def get_matches_symbols(self, symbols, exclude_overlaps=True, match_kind=None):
+        """ Match a text that has already been translated with encode_symbols.
+        The returned matches do not have elems set. """
+        cdef vector[uint32_t] cppsymbols = symbols
+        return self.cppmatches_to_matches(self.cpp_automaton.get_matches_symbols(cppsymbols, to_match_kind(exclude_overlaps, match_kind), 0))
+
+    def iter_matches(self, text, match_kind='all', max_matches=None):
+        """ Iterate over the matches of a text as they are found, without collecting all of them first,
+        so that the memory used does not grow with the number of matches. The matches come in the
+        order of their end positions for 'all' and from left to right for the leftmost kinds,
+        'no_overlaps' needs all the matches and is not supported. Stops after max_matches matches
+        if it is given. """
+        if match_kind == 'no_overlaps':
+            raise ValueError('Overlaps can not be removed while iterating, use a leftmost match kind instead')
+        return MatchIterator(self, text, to_match_kind(False, match_kind), max_matches)
+
+    def matcher(self):
+        """ Create a streaming matcher that is fed the text chunk by chunk. """
+        return Matcher(self)
+
+    def stream_matches(self, chunks):
+        """ Lazily match a text that is given as an iterable of chunks, e.g. lines of a file.
+        Every chunk is a string or a list of tokens, matches may span several chunks and
+        their positions are relative to the start of the whole text. """
+        matcher = Matcher(self)
+        for chunk in chunks:
+            for match in matcher.feed(chunk):
+                yield match
+
+    def items(self, prefix=None, limit=None, offset=0):
+        """ Generate the patterns and their values in the order of their tokens, only the ones
+        starting with prefix if it is given. The first offset patterns are skipped and at most
+        limit patterns are generated. The patterns are read from the automaton a batch at a time,
+        so iterating over a part of a large automaton is cheap. """
+        cursor = TrieCursor(self, prefix, False, offset, limit)
+        while True:
+            batch = cursor.next_batch()
+            if not batch:
+                return
+            for key, value in batch:
+                yield self.decode_pattern(key), self.decode_value(value)
+
+    def prefixes(self, prefix=None, limit=None, offset=0):
+        """ Generate all the prefixes of the patterns and their values, the value is empty if a
+        prefix is not a pattern itself. The arguments are the same as for items. """
+        cursor = TrieCursor(self, prefix, True, offset, limit)
+        while True:
+            batch = cursor.next_batch()
+            if not batch:
+                return
+            for key, value in batch:
+                try:
+                    key = self.decode_pattern(key)
+                except UnicodeDecodeError:
+                    continue # the prefix is not valid UTF-8 in byte mode
+                yield key, self.decode_value(value)
 
     '''def keys(self):
         for key, value in self.items():
@@ -207,17 +762,47 @@ cdef class Automaton:
     def save_to_string(self):
         return self.cpp_automaton.serialize()
 
+    def save_mmap(self, fnm):
+        """ Compile the automaton and save it in a binary format that can be used with load_mmap. """
+        self.cpp_automaton.save_mapped(encode(fnm))
+
+    def content_hash(self):
+        """ Get a hash of the patterns and their values, which identifies a version of the dictionary
+        regardless of the order the patterns were added in. """
+        return self.cpp_automaton.content_hash()
+
+    def save_delta_to_file(self, base, fnm):
+        """ Save the patterns added, changed and removed since the base automaton, so that the automata
+        loaded from base can be brought up to date with apply_delta_from_file. """
+        self.cpp_automaton.serialize_delta_to((<Automaton?>base).cpp_automaton[0], encode(fnm))
+
+    def save_delta_to_string(self, base):
+        return self.cpp_automaton.serialize_delta((<Automaton?>base).cpp_automaton[0])
+
+    def apply_delta_from_file(self, fnm):
+        """ Apply a delta saved by save_delta_to_file, only the parts of the automaton the changed patterns
+        affect are updated. Raises RuntimeError, leaving the automaton as it is, if the delta was saved for
+        another version of the dictionary. Returns the number of patterns changed. """
+        self.generation += 1
+        self.label_cache = {}
+        return self.cpp_automaton.apply_delta_from(encode(fnm))
+
+    def apply_delta_from_string(self, data):
+        self.generation += 1
+        self.label_cache = {}
+        return self.cpp_automaton.apply_delta(data)
+
     def __getitem__(self, pattern):
-        value = decode(self.cpp_automaton.get_value(encode_list(pattern)))
-        if len(value) == 0:
+        cdef uint32_t label_id = self.find_label(pattern)
+        if label_id == 0:
             raise KeyError(pattern)
-        return value
+        return self.label_of(label_id)
 
     def get(self, pattern, default=None):
-        try:
-            return self[pattern]
-        except KeyError as exc:
+        cdef uint32_t label_id = self.find_label(pattern)
+        if label_id == 0:
             return default
+        return self.label_of(label_id)
 
     def __setitem__(self, pattern, value):
         self.add(pattern, value)
@@ -226,13 +811,178 @@ cdef class Automaton:
         self.add(pattern, value)
 
     def __delitem__(self, pattern):
-        value = self[pattern] # if value does not exist, raise an exception
-        self.add(pattern, '')
+        if not self.remove(pattern):
+            raise KeyError(pattern)
 
     def __contains__(self, pattern):
         value = self.get(pattern, None)
         return value is not None
 
     def str(self):
+        if self.cpp_automaton.is_byte_mode():
+            # the nodes of multibyte characters are printed byte by byte
+            return self.cpp_automaton.str().decode('utf-8', 'replace')
         return decode(self.cpp_automaton.str())
 
+
+
+cdef class MatchArray:
+    """ Matches in a contiguous C++ array, exposed through the buffer protocol as
+    a read-only int32 array of shape (number of matches, 3) with the columns start, end and label id.
+    It can be used without copying with e.g. memoryview(matches) or numpy.asarray(matches). """
+    cdef vector[CppMatch] matches
+    cdef Py_ssize_t shape[2]
+    cdef Py_ssize_t strides[2]
+
+    def __len__(self):
+        return self.matches.size()
+
+    def __getbuffer__(self, Py_buffer* buffer, int flags):
+        if flags & PyBUF_WRITABLE:
+            raise BufferError('MatchArray is read-only')
+        # CppMatch is laid out as three 32-bit ints, see match.h, so the rows are C contiguous
+        self.shape[0] = self.matches.size()
+        self.shape[1] = 3
+        self.strides[0] = sizeof(CppMatch)
+        self.strides[1] = sizeof(int)
+        if (flags & PyBUF_F_CONTIGUOUS) == PyBUF_F_CONTIGUOUS and self.shape[0] > 1:
+            raise BufferError('MatchArray is not Fortran contiguous')
+        buffer.buf = <void*>self.matches.data()
+        buffer.format = NULL
+        if flags & PyBUF_FORMAT:
+            buffer.format = 'i'
+        buffer.internal = NULL
+        buffer.itemsize = sizeof(int)
+        buffer.len = self.shape[0] * self.shape[1] * sizeof(int)
+        buffer.obj = self
+        buffer.readonly = 1
+        # without a shape the consumer sees the ints as a flat array
+        if (flags & PyBUF_ND) == PyBUF_ND:
+            buffer.ndim = 2
+            buffer.shape = self.shape
+        else:
+            buffer.ndim = 1
+            buffer.shape = NULL
+        buffer.strides = NULL
+        if (flags & PyBUF_STRIDES) == PyBUF_STRIDES:
+            buffer.strides = self.strides
+        buffer.suboffsets = NULL
+
+    def __releasebuffer__(self, Py_buffer* buffer):
+        pass
+
+
+cdef class MatchIterator:
+    """ Iterator over the matches of a single text, see Automaton.iter_matches. The text is
+    scanned a part at a time when the matches found so far have been consumed. """
+    cdef Automaton automaton
+    cdef long generation
+    cdef CppMatchCursor cursor
+    cdef CppMatchKind kind
+    cdef object text
+    cdef bytes data
+    cdef vector[uint32_t] symbols
+    cdef bool utf8_offsets
+    cdef object remaining
+    cdef list pending
+    cdef Py_ssize_t index
+
+    def __cinit__(self, Automaton automaton, text, CppMatchKind kind, max_matches):
+        self.automaton = automaton
+        self.generation = automaton.generation
+        self.kind = kind
+        self.text = text
+        self.remaining = max_matches
+        self.pending = []
+        self.index = 0
+        if automaton.cpp_automaton.is_byte_mode():
+            self.data = encode_bytes(text)
+            # positions are bytes for a bytes text and characters otherwise, as in get_matches
+            self.utf8_offsets = not isinstance(text, six.binary_type)
+            if self.utf8_offsets and not isinstance(text, six.string_types):
+                self.text = self.data.decode('utf-8')
+        else:
+            self.symbols = automaton.cpp_automaton.encode_symbols(automaton.encode_tokens(text))
+
+    def __iter__(self):
+        return self
+
+    def __next__(self):
+        cdef vector[CppMatch] cppmatches
+        if self.remaining is not None and self.remaining <= 0:
+            raise StopIteration
+        while self.index >= len(self.pending):
+            if self.generation != self.automaton.generation:
+                raise RuntimeError('The automaton was replaced or had patterns removed during the iteration')
+            if self.automaton.cpp_automaton.is_byte_mode():
+                cppmatches = self.automaton.cpp_automaton.next_matches_bytes(self.cursor, self.data, len(self.data),
+                                                                             self.kind, ITER_BATCH, self.utf8_offsets)
+            else:
+                cppmatches = self.automaton.cpp_automaton.next_matches(self.cursor, self.symbols, self.kind, ITER_BATCH)
+            if cppmatches.size() == 0:
+                raise StopIteration
+            self.pending = self.automaton.cppmatches_to_matches(cppmatches)
+            self.index = 0
+        match = self.pending[self.index]
+        self.pending[self.index] = None
+        self.index += 1
+        if self.remaining is not None:
+            self.remaining -= 1
+        match.set_elems(self.text[match.start:match.end])
+        return match
+
+
+cdef class TrieCursor:
+    """ Position of an iteration over the patterns or the prefixes of an automaton, see Automaton.items. """
+    cdef Automaton automaton
+    cdef long generation
+    cdef CppTrieCursor cursor
+
+    def __cinit__(self, Automaton automaton, prefix, bool prefixes, size_t offset, limit):
+        self.automaton = automaton
+        self.generation = automaton.generation
+        tokens = automaton.encode_pattern(prefix) if prefix is not None else []
+        automaton.cpp_automaton.start_items(self.cursor, tokens, prefixes, offset,
+                                            <size_t>-1 if limit is None else <size_t>limit)
+
+    def next_batch(self):
+        """ Get the next keys, as lists of encoded tokens, and values, an empty list at the end. """
+        if self.cursor.done():
+            return []
+        if self.generation != self.automaton.generation:
+            raise RuntimeError('The automaton was replaced or had patterns removed during the iteration')
+        return self.automaton.cpp_automaton.next_items(self.cursor, ITEMS_BATCH)
+
+
+cdef class Matcher:
+    """ Streaming matcher that finds the matches of an automaton in a text fed chunk by chunk.
+    Only the matches that end in a chunk are returned by feed, matches that span several chunks
+    are returned with the chunk they end in. The matches of a chunk are ordered by their end positions
+    and they do not have elems set. The positions are byte offsets in byte mode. A character split
+    between chunks is matched with the chunk that completes it, so that it can be case folded. """
+    cdef Automaton automaton
+    cdef long generation
+    cdef CppMatcherState state
+
+    def __cinit__(self, Automaton automaton):
+        self.automaton = automaton
+        self.generation = automaton.generation
+
+    def feed(self, chunk):
+        if self.generation != self.automaton.generation:
+            raise RuntimeError('The automaton was replaced or had patterns removed after creating the matcher')
+        cdef bytes data
+        if self.automaton.cpp_automaton.is_byte_mode():
+            data = encode_bytes(chunk)
+            return self.automaton.cppmatches_to_matches(self.automaton.cpp_automaton.feed_bytes(self.state, data, len(data)))
+        return self.automaton.cppmatches_to_matches(self.automaton.cpp_automaton.feed(self.state, self.automaton.encode_tokens(chunk)))
+
+    def reset(self):
+        """ Start matching a new text. """
+        self.state.reset()
+        self.generation = self.automaton.generation
+
+    @property
+    def offset(self):
+        """ The number of tokens, or bytes in byte mode, fed so far. """
+        return self.state.get_offset()
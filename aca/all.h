@@ -18,4 +18,8 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 #include "match.h"
 #include "node.h"
+#include "matcher.h"
+#include "parallel.h"
+#include "casefold.h"
+#include "stats.h"
 #include "automaton.h"
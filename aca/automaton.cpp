@@ -19,6 +19,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "automaton.h"
 #include "match.h"
 #include "node.h"
+#include "parallel.h"
 
 #include <iostream>
 #include <fstream>
@@ -26,223 +27,1686 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <algorithm>
 #include <deque>
 #include <exception>
+#include <stdexcept>
+#include <map>
 #include <set>
 
 
 BEGIN_NAMESPACE(aca)
 
-CppAutomaton::CppAutomaton() : uptodate(false) {
-    root = std::make_shared<CppNode>(0, -1);
-    nodes.push_back(root);
+const uint64_t CppAutomaton::FLAG_BYTE_MODE;
+const uint64_t CppAutomaton::FLAG_ASCII_FOLD;
+const uint64_t CppAutomaton::FLAG_UNICODE_FOLD;
+const uint64_t CppAutomaton::FLAG_NO_NFC;
+const uint64_t CppAutomaton::FLAG_MULTI_DICT;
+
+CppAutomaton::CppAutomaton(const bool byte_mode, const CppCaseFold case_fold, const bool multi_dictionary)
+        : uptodate(false), flags(multi_dictionary ? FLAG_MULTI_DICT : 0), next_rank(0), hash(0), hashed(false) {
+    nodes.push_back(CppNode(-1));
+    labels.intern("");
+    if (byte_mode) {
+        init_byte_mode();
+    }
+    if (case_fold == CASE_FOLD_ASCII) {
+        flags |= FLAG_ASCII_FOLD;
+    } else if (case_fold == CASE_FOLD_UNICODE) {
+        flags |= FLAG_UNICODE_FOLD;
+    }
+}
+
+CppCaseFold CppAutomaton::get_case_fold() const {
+    if (flags & FLAG_UNICODE_FOLD) {
+        return CASE_FOLD_UNICODE;
+    }
+    return (flags & FLAG_ASCII_FOLD) ? CASE_FOLD_ASCII : CASE_FOLD_NONE;
+}
+
+void CppAutomaton::set_nfc(const bool nfc) {
+    flags = nfc ? (flags & ~FLAG_NO_NFC) : (flags | FLAG_NO_NFC);
+    if (dfa) {
+        dfa->set_flags(flags);
+    }
+}
+
+StringVector CppAutomaton::fold_pattern(const StringVector& pattern) const {
+    const CppCaseFold case_fold = get_case_fold();
+    if (case_fold == CASE_FOLD_NONE) {
+        return pattern;
+    }
+    StringVector folded;
+    folded.reserve(pattern.size());
+    if (is_byte_mode()) {
+        // the bytes of a code point are separate tokens, so the pattern is folded as a whole.
+        // Folding keeps the length of the pattern, as texts are folded in place.
+        std::string text;
+        for (const std::string& token : pattern) {
+            text += token;
+        }
+        for (const char byte : cpp_case_fold(text, case_fold, true)) {
+            folded.push_back(std::string(1, byte));
+        }
+    } else {
+        for (const std::string& token : pattern) {
+            folded.push_back(cpp_case_fold(token, case_fold, false));
+        }
+    }
+    return folded;
+}
+
+std::string CppAutomaton::fold_token(const std::string& token) const {
+    const CppCaseFold case_fold = get_case_fold();
+    return case_fold == CASE_FOLD_NONE ? token : cpp_case_fold(token, case_fold, is_byte_mode());
+}
+
+SymbolId CppAutomaton::find_symbol(const std::string& token) const {
+    return folded_symbol(fold_token(token));
+}
+
+SymbolId CppAutomaton::folded_symbol(const std::string& token) const {
+    if (is_byte_mode()) {
+        // symbol id b is the byte b
+        return token.size() == 1 ? static_cast<unsigned char>(token[0]) : NO_SYMBOL;
+    }
+    return is_read_only() ? dfa->find_symbol(token) : symbols.find(token);
+}
+
+void CppAutomaton::init_byte_mode() {
+    flags |= FLAG_BYTE_MODE;
+    for (int b=0 ; b<256 ; ++b) {
+        symbols.intern(std::string(1, static_cast<char>(b)));
+    }
+}
+
+// the symbol ids of the elements of a text, bytes are their own ids
+static inline SymbolId to_symbol(const SymbolId symbol) {
+    return symbol;
+}
+
+static inline SymbolId to_symbol(const char byte) {
+    return static_cast<unsigned char>(byte);
+}
+
+// the position of the first symbol from idx on that can start a match, bytes are searched with
+// the SIMD kernels of the prefilter
+static inline long skip_to_candidate(const CppPrefilter& prefilter, const char* first, const long idx,
+                                     const long size) {
+    return prefilter.find(first + idx, first + size) - first;
+}
+
+static inline long skip_to_candidate(const CppPrefilter& prefilter, const CppFoldedBytes& first, const long idx,
+                                     const long size) {
+    const char* text = first.position();
+    return prefilter.find(text + idx, text + size) - text;
+}
+
+template <class Iter>
+static inline long skip_to_candidate(const CppPrefilter& prefilter, const Iter first, const long idx,
+                                     const long size) {
+    return prefilter.find_symbol(first + idx, first + size) - first;
+}
+
+// Adapts the keyword tree to the interface of CppDfa, so that the matching
+// loops can be written once for both of them.
+struct CppAutomaton::TrieGraph {
+    const CppAutomaton& automaton;
+    CppScanCounter& counter;
+
+    TrieGraph(const CppAutomaton& automaton, CppScanCounter& counter) : automaton(automaton), counter(counter) { }
+
+    NodeId next_state(NodeId state, const SymbolId symbol) const {
+        NodeId next;
+        while ((next = automaton.goto_node(state, symbol)) == NO_NODE) {
+            state = automaton.fail_table[state]; // follow fail
+            counter.fail_link();
+        }
+        return next;
+    }
+    int get_depth(const NodeId state) const { return automaton.nodes[state].depth; }
+    NodeId get_output(const NodeId state) const { return automaton.nodes[state].output; }
+    bool is_terminal(const NodeId state) const { return automaton.nodes[state].is_terminal(); }
+    LabelId get_label(const NodeId state) const { return automaton.nodes[state].value; }
+    uint32_t get_rank(const NodeId state) const { return automaton.nodes[state].rank; }
+};
+
+void CppAutomaton::check_writable() const {
+    if (is_read_only()) {
+        throw std::runtime_error("ERROR! Mapped automaton can not be modified!");
+    }
+}
+
+void CppAutomaton::check_pattern(const StringVector& pattern) const {
+    if (is_byte_mode()) {
+        for (const std::string& token : pattern) {
+            if (token.size() != 1) {
+                throw std::runtime_error("ERROR! The tokens of a pattern must be single bytes in byte mode!");
+            }
+        }
+    }
+}
+
+void CppAutomaton::check_value(const std::string& value) const {
+    if (is_multi_dictionary()) {
+        CppDictionaryIndex::decode(value);
+    }
+}
+
+LabelId CppAutomaton::intern_value(const std::string& value, const LabelId label) {
+    if (!is_multi_dictionary()) {
+        return labels.intern(value);
+    }
+    if (value.empty()) {
+        if (label != NO_LABEL) {
+            dictionaries.clear_set(label);
+        }
+        return NO_LABEL;
+    }
+    return dictionaries.assign(label, CppDictionaryIndex::decode(value));
+}
+
+void CppAutomaton::add(const StringVector& pattern, const std::string& value) {
+    #ifdef ACA_DEBUG
+        std::cout << "adding pattern with value <" << value << "> where pattern is ";
+        for (const std::string& s : pattern) {
+            std::cout << s << " ";
+        }
+        std::cout << "\n";
+    #endif
+    check_writable();
+    check_pattern(pattern);
+    check_value(value);
+    const NodeId node_id = add_path(pattern);
+    set_node_value(node_id, intern_value(value, nodes[node_id].get_value()));
+}
+
+NodeId CppAutomaton::add_path(const StringVector& pattern) {
+    const StringVector folded = fold_pattern(pattern);
+    const bool incremental = uptodate.load();
+    NodeId node_id = 0;
+    NodeId outnode;
+    for (size_t depth=0 ; depth<folded.size() ; ++depth) {
+        const SymbolId elem = symbols.intern(folded[depth]);
+        outnode = nodes[node_id].get_outnode(elem);
+        if (outnode != NO_NODE) {
+            node_id = outnode;
+        } else {
+            // nodes may be reallocated, so never keep references to them across push_back
+            const NodeId newnode = static_cast<NodeId>(nodes.size());
+            nodes.push_back(CppNode(depth));
+            nodes[node_id].set_outnode(elem, newnode);
+            if (incremental) {
+                link_new_node(node_id, elem, newnode);
+                if (node_id == 0) {
+                    prefilter.add_symbol(elem);
+                }
+            }
+            node_id = newnode;
+        }
+    }
+    return node_id;
+}
+
+void CppAutomaton::set_node_value(const NodeId node_id, const LabelId label) {
+    const bool incremental = uptodate.load();
+    const bool was_terminal = nodes[node_id].is_terminal();
+    if (!was_terminal) {
+        nodes[node_id].rank = next_rank++;
+    }
+    nodes[node_id].set_value(label);
+    if (incremental && node_id != 0 && was_terminal != nodes[node_id].is_terminal()) {
+        relink_outputs(node_id);
+    }
+    dfa.reset();
+    lookup.reset();
+    hashed = false;
+}
+
+void CppAutomaton::build_from(const KeyValueVector& items, const unsigned num_threads) {
+    check_writable();
+    for (const KeyValue& item : items) {
+        check_pattern(item.first);
+        check_value(item.second);
+    }
+    // a full update is cheaper than incremental ones for many patterns
+    uptodate = false;
+    dfa.reset();
+    lookup.reset();
+    hashed = false;
+    if (!nodes[0].outs.empty()) {
+        for (const KeyValue& item : items) {
+            add(item.first, item.second);
+        }
+        update_automaton(num_threads);
+        return;
+    }
+
+    // encode the patterns and sort them, so that the patterns of a subtree are consecutive.
+    // The sort is stable, so that the last value of a repeated pattern wins as with add
+    // and its first occurrence gives its rank.
+    std::vector<SymbolVector> patterns(items.size());
+    IntVector values(items.size());
+    const bool folding = get_case_fold() != CASE_FOLD_NONE;
+    StringVector folded;
+    for (size_t i=0 ; i<items.size() ; ++i) {
+        values[i] = intern_value(items[i].second);
+        if (folding) {
+            folded = fold_pattern(items[i].first);
+        }
+        const StringVector& pattern = folding ? folded : items[i].first;
+        patterns[i].reserve(pattern.size());
+        for (const std::string& token : pattern) {
+            patterns[i].push_back(is_byte_mode() ? to_symbol(token[0]) : symbols.intern(token));
+        }
+    }
+    IntVector order(items.size());
+    for (size_t i=0 ; i<order.size() ; ++i) {
+        order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(), [&](const int a, const int b) {
+        return patterns[a] < patterns[b];
+    });
+
+    // the patterns starting with the same symbol make up one subtree of the root
+    std::vector<std::pair<size_t, size_t>> groups;
+    for (size_t i=0 ; i<order.size() ; ++i) {
+        const SymbolVector& pattern = patterns[order[i]];
+        if (pattern.empty()) {
+            if (!nodes[0].is_terminal()) {
+                nodes[0].rank = order[i];
+            }
+            nodes[0].set_value(values[order[i]]);
+        } else if (groups.empty() || patterns[order[groups.back().first]][0] != pattern[0]) {
+            groups.push_back(std::make_pair(i, i + 1));
+        } else {
+            groups.back().second = i + 1;
+        }
+    }
+    #ifdef ACA_DEBUG
+        std::cout << "building " << groups.size() << " subtrees from " << items.size() << " patterns\n";
+    #endif
+
+    // build the subtrees with local node ids, each pattern shares its prefix with the previous one
+    std::vector<NodeVector> subtrees(groups.size());
+    cpp_parallel_for(groups.size(), num_threads, [&](const size_t g) {
+        NodeVector& subtree = subtrees[g];
+        IntVector path;
+        const SymbolVector* prev = nullptr;
+        for (size_t i=groups[g].first ; i<groups[g].second ; ++i) {
+            const SymbolVector& pattern = patterns[order[i]];
+            size_t common = 0;
+            while (prev != nullptr && common < prev->size() && common < pattern.size()
+                    && (*prev)[common] == pattern[common]) {
+                ++common;
+            }
+            path.resize(common);
+            for (size_t depth=common ; depth<pattern.size() ; ++depth) {
+                const NodeId node_id = static_cast<NodeId>(subtree.size());
+                subtree.push_back(CppNode(depth));
+                if (depth > 0) {
+                    auto& outs = subtree[path.back()].outs;
+                    outs.emplace_hint(outs.end(), pattern[depth], node_id);
+                }
+                path.push_back(node_id);
+            }
+            CppNode& node = subtree[path.back()];
+            if (!node.is_terminal()) {
+                node.rank = order[i];
+            }
+            node.set_value(values[order[i]]);
+            prev = &pattern;
+        }
+    });
+
+    // move the subtrees after the root
+    IntVector bases(groups.size() + 1, 1);
+    for (size_t g=0 ; g<groups.size() ; ++g) {
+        bases[g + 1] = bases[g] + subtrees[g].size();
+        nodes[0].outs[patterns[order[groups[g].first]][0]] = bases[g];
+    }
+    nodes.resize(bases[groups.size()], CppNode(0));
+    cpp_parallel_for(groups.size(), num_threads, [&](const size_t g) {
+        for (size_t i=0 ; i<subtrees[g].size() ; ++i) {
+            CppNode& node = subtrees[g][i];
+            for (auto iter=node.outs.begin() ; iter != node.outs.end() ; ++iter) {
+                iter->second += bases[g];
+            }
+            nodes[bases[g] + i] = std::move(node);
+        }
+        NodeVector().swap(subtrees[g]);
+    });
+    next_rank = static_cast<uint32_t>(items.size());
+    update_automaton(num_threads);
+}
+
+void CppAutomaton::add_entry(const StringVector& pattern, const DictId dict, const std::string& value) {
+    if (!is_multi_dictionary()) {
+        throw std::runtime_error("ERROR! Dictionary entries can only be added to a multi-dictionary automaton!");
+    }
+    if (value.empty()) {
+        throw std::runtime_error("ERROR! The value of a dictionary entry can not be empty!");
+    }
+    check_writable();
+    check_pattern(pattern);
+    const NodeId node_id = add_path(pattern);
+    set_node_value(node_id, dictionaries.set_entry(nodes[node_id].get_value(), dict, value));
+}
+
+bool CppAutomaton::remove_entry(const StringVector& pattern, const DictId dict) {
+    if (!is_multi_dictionary()) {
+        throw std::runtime_error("ERROR! Dictionary entries can only be removed from a multi-dictionary automaton!");
+    }
+    check_writable();
+    const LabelId label = find_label(pattern);
+    if (label == NO_LABEL || !dictionaries.remove_entry(label, dict)) {
+        return false;
+    }
+    if (dictionaries.get_entries(label).empty()) {
+        return remove(pattern);
+    }
+    // the label of the pattern stays the same, only the compiled values change
+    dfa.reset();
+    hashed = false;
+    return true;
+}
+
+bool CppAutomaton::remove(const StringVector& pattern) {
+    check_writable();
+    IntVector path(1, 0);
+    SymbolVector elems;
+    for (const std::string& token : fold_pattern(pattern)) {
+        const SymbolId elem = symbols.find(token);
+        const NodeId next = elem != NO_SYMBOL ? nodes[path.back()].get_outnode(elem) : NO_NODE;
+        if (next == NO_NODE) {
+            return false;
+        }
+        elems.push_back(elem);
+        path.push_back(next);
+    }
+    const NodeId node_id = path.back();
+    if (!nodes[node_id].is_terminal()) {
+        return false;
+    }
+    const bool incremental = uptodate.load();
+    if (is_multi_dictionary()) {
+        dictionaries.clear_set(nodes[node_id].get_value());
+    }
+    nodes[node_id].set_value(NO_LABEL);
+    if (incremental && node_id != 0) {
+        relink_outputs(node_id);
+    }
+    // prune the end of the path up to the first node that still leads to a pattern
+    for (size_t depth=elems.size() ; depth>0 ; --depth) {
+        const NodeId dead_id = path[depth];
+        if (nodes[dead_id].is_terminal() || !nodes[dead_id].outs.empty()) {
+            break;
+        }
+        nodes[path[depth - 1]].outs.erase(elems[depth - 1]);
+        if (incremental) {
+            unlink_dead_node(dead_id);
+        }
+        nodes[dead_id].output = NO_NODE;
+    }
+    dfa.reset();
+    lookup.reset();
+    hashed = false;
+    return true;
+}
+
+void CppAutomaton::unlink_dead_node(const NodeId node_id) {
+    // the suffixes of the nodes failing to the pruned node that are shorter than it are suffixes of
+    // the pruned node too, so the next longest suffix is its fail node. The pruned node is not
+    // terminal, so the output links stay the same.
+    const NodeId fail_id = fail_table[node_id];
+    NodeId child_id = fail_first[node_id];
+    while (child_id != NO_NODE) {
+        const NodeId next_id = fail_next[child_id];
+        fail_table[child_id] = fail_id;
+        fail_tree_attach(child_id, fail_id);
+        child_id = next_id;
+    }
+    fail_first[node_id] = NO_NODE;
+    fail_tree_detach(node_id);
+}
+
+void CppAutomaton::compact() {
+    if (is_read_only()) {
+        return;
+    }
+    const bool compiled = is_compiled();
+    // new ids in breadth first order, NO_NODE for the pruned nodes
+    IntVector order(1, 0);
+    IntVector new_ids(nodes.size(), NO_NODE);
+    new_ids[0] = 0;
+    for (size_t i=0 ; i<order.size() ; ++i) {
+        const CppNode& node = nodes[order[i]];
+        for (auto iter=node.outs.begin() ; iter != node.outs.end() ; ++iter) {
+            new_ids[iter->second] = static_cast<NodeId>(order.size());
+            order.push_back(iter->second);
+        }
+    }
+    #ifdef ACA_DEBUG
+        std::cout << "compacting " << nodes.size() << " nodes to " << order.size() << "\n";
+    #endif
+    NodeVector compacted;
+    compacted.reserve(order.size());
+    for (const NodeId old_id : order) {
+        CppNode& node = nodes[old_id];
+        for (auto iter=node.outs.begin() ; iter != node.outs.end() ; ++iter) {
+            iter->second = new_ids[iter->second];
+        }
+        node.output = node.output != NO_NODE ? new_ids[node.output] : NO_NODE;
+        compacted.push_back(std::move(node));
+    }
+    nodes.swap(compacted);
+    // intern again only the values of the patterns that are left, the replaced and removed values are freed
+    if (is_multi_dictionary()) {
+        CppDictionaryIndex live_sets;
+        for (CppNode& node : nodes) {
+            if (node.is_terminal()) {
+                node.set_value(live_sets.assign(NO_LABEL, dictionaries.get_set(node.get_value())));
+            }
+        }
+        dictionaries = std::move(live_sets);
+    } else {
+        CppSymbolTable live_labels;
+        live_labels.intern("");
+        for (CppNode& node : nodes) {
+            node.set_value(live_labels.intern(labels.get_symbol(node.get_value())));
+        }
+        labels = std::move(live_labels);
+    }
+    if (uptodate.load()) {
+        IntVector fails(order.size());
+        for (size_t i=0 ; i<order.size() ; ++i) {
+            fails[i] = new_ids[fail_table[order[i]]];
+        }
+        fail_table.swap(fails);
+        link_fail_tree();
+    } else {
+        fail_table.clear();
+    }
+    dfa.reset();
+    lookup.reset();
+    if (compiled) {
+        compile();
+    }
+}
+
+void CppAutomaton::link_fail_tree() {
+    fail_first.assign(nodes.size(), NO_NODE);
+    fail_next.assign(nodes.size(), NO_NODE);
+    fail_prev.assign(nodes.size(), NO_NODE);
+    // only the nodes reachable from the root, pruned nodes stay out of the tree
+    IntVector order(1, 0);
+    for (size_t i=0 ; i<order.size() ; ++i) {
+        const CppNode& node = nodes[order[i]];
+        for (auto iter=node.outs.begin() ; iter != node.outs.end() ; ++iter) {
+            fail_tree_attach(iter->second, fail_table[iter->second]);
+            order.push_back(iter->second);
+        }
+    }
+}
+
+void CppAutomaton::fail_tree_attach(const NodeId node_id, const NodeId fail_id) {
+    fail_prev[node_id] = NO_NODE;
+    fail_next[node_id] = fail_first[fail_id];
+    if (fail_first[fail_id] != NO_NODE) {
+        fail_prev[fail_first[fail_id]] = node_id;
+    }
+    fail_first[fail_id] = node_id;
+}
+
+void CppAutomaton::fail_tree_detach(const NodeId node_id) {
+    if (fail_prev[node_id] != NO_NODE) {
+        fail_next[fail_prev[node_id]] = fail_next[node_id];
+    } else {
+        fail_first[fail_table[node_id]] = fail_next[node_id];
+    }
+    if (fail_next[node_id] != NO_NODE) {
+        fail_prev[fail_next[node_id]] = fail_prev[node_id];
+    }
+    fail_prev[node_id] = fail_next[node_id] = NO_NODE;
+}
+
+void CppAutomaton::link_new_node(const NodeId parent_id, const SymbolId elem, const NodeId node_id) {
+    // the fail link of the new node itself, as in update_automaton
+    NodeId fail_id = 0;
+    if (parent_id != 0) {
+        NodeId fail_node_id = fail_table[parent_id];
+        while (goto_node(fail_node_id, elem) == NO_NODE) {
+            fail_node_id = fail_table[fail_node_id];
+        }
+        fail_id = goto_node(fail_node_id, elem);
+    }
+    fail_table.push_back(fail_id);
+    fail_first.push_back(NO_NODE);
+    fail_next.push_back(NO_NODE);
+    fail_prev.push_back(NO_NODE);
+    fail_tree_attach(node_id, fail_id);
+    const CppNode& fail_node = nodes[fail_id];
+    nodes[node_id].output = (fail_id != 0 && fail_node.is_terminal()) ? fail_id : fail_node.output;
+
+    // The nodes ending with the new node are the elem children of the nodes ending with its parent,
+    // which are the parent's descendants in the fail tree. A descendant that already has an elem
+    // child shadows its own descendants, whose elem children fail to that child or deeper.
+    // The moved nodes used to fail to fail_id, so their output links stay the same until
+    // the new node becomes terminal.
+    IntVector stack;
+    for (NodeId child_id = fail_first[parent_id] ; child_id != NO_NODE ; child_id = fail_next[child_id]) {
+        stack.push_back(child_id);
+    }
+    while (!stack.empty()) {
+        const NodeId suffix_id = stack.back(); stack.pop_back();
+        const NodeId target_id = nodes[suffix_id].get_outnode(elem);
+        if (target_id != NO_NODE) {
+            if (nodes[fail_table[target_id]].depth < nodes[node_id].depth) {
+                fail_tree_detach(target_id);
+                fail_table[target_id] = node_id;
+                fail_tree_attach(target_id, node_id);
+            }
+            continue;
+        }
+        for (NodeId child_id = fail_first[suffix_id] ; child_id != NO_NODE ; child_id = fail_next[child_id]) {
+            stack.push_back(child_id);
+        }
+    }
+}
+
+void CppAutomaton::relink_outputs(const NodeId node_id) {
+    // the descendants in the fail tree that are not below another terminal node output to node_id
+    // if it is terminal and to the output of node_id otherwise
+    const NodeId output_id = nodes[node_id].is_terminal() ? node_id : nodes[node_id].output;
+    IntVector stack(1, node_id);
+    while (!stack.empty()) {
+        const NodeId parent_id = stack.back(); stack.pop_back();
+        for (NodeId child_id = fail_first[parent_id] ; child_id != NO_NODE ; child_id = fail_next[child_id]) {
+            nodes[child_id].output = output_id;
+            if (!nodes[child_id].is_terminal()) {
+                stack.push_back(child_id);
+            }
+        }
+    }
+}
+
+SymbolVector CppAutomaton::encode_symbols(const StringVector& tokens) const {
+    if (is_read_only() || get_case_fold() != CASE_FOLD_NONE) {
+        SymbolVector result;
+        result.reserve(tokens.size());
+        for (const std::string& token : tokens) {
+            result.push_back(find_symbol(token));
+        }
+        return result;
+    }
+    return symbols.encode(tokens);
+}
+
+NodeId CppAutomaton::find_node(const StringVector& prefix) const {
+    const bool read_only = is_read_only();
+    const StringVector folded = fold_pattern(prefix);
+    NodeId node_id = 0;
+    for (size_t idx=0 ; idx<folded.size() ; ++idx) {
+        const SymbolId elem = read_only ? dfa->find_symbol(folded[idx]) : symbols.find(folded[idx]);
+        if (elem == NO_SYMBOL) {
+            return NO_NODE;
+        }
+        node_id = read_only ? dfa->find_child(node_id, elem) : nodes[node_id].get_outnode(elem);
+        if (node_id == NO_NODE) {
+            return NO_NODE;
+        }
+    }
+    return node_id;
+}
+
+int CppAutomaton::get_node_depth(const NodeId node_id) const {
+    return is_read_only() ? dfa->get_depth(node_id) : nodes[node_id].depth;
+}
+
+std::string CppAutomaton::get_node_value(const NodeId node_id) const {
+    return is_read_only() ? dfa->get_value(node_id) : get_label(nodes[node_id].value);
+}
+
+std::string CppAutomaton::get_label(const LabelId label) const {
+    if (is_read_only()) {
+        return dfa->get_label_string(label);
+    }
+    return is_multi_dictionary() ? dictionaries.encode_set(label) : labels.get_symbol(label);
+}
+
+size_t CppAutomaton::num_labels() const {
+    if (is_read_only()) {
+        return dfa->num_labels();
+    }
+    return is_multi_dictionary() ? dictionaries.num_sets() : labels.size();
+}
+
+size_t CppAutomaton::num_nodes() const {
+    return is_read_only() ? dfa->size() : nodes.size();
+}
+
+CppStats CppAutomaton::get_stats() const {
+    CppStats stats;
+    const bool read_only = is_read_only();
+    // the output links are only valid in an up to date automaton
+    const bool linked = dfa || uptodate.load();
+    // the number of matches reported in each node, the output node of a node is less
+    // deep than the node, so it is always counted first in breadth first order
+    std::vector<size_t> reported(num_nodes(), 0);
+    std::vector<std::pair<SymbolId, NodeId>> children;
+    // walk the reachable nodes breadth first with their depths, pruned nodes are unreachable
+    std::deque<std::pair<NodeId, size_t>> Q;
+    Q.push_back(std::make_pair(0, 0));
+    while (Q.size() > 0) {
+        const NodeId node_id = Q[0].first;
+        const size_t depth = Q[0].second;
+        Q.pop_front();
+        NodeId output;
+        if (read_only) {
+            dfa->get_children(node_id, children);
+            reported[node_id] = dfa->is_terminal(node_id) ? 1 : 0;
+            output = dfa->get_output(node_id);
+        } else {
+            const CppNode& node = nodes[node_id];
+            children.assign(node.outs.begin(), node.outs.end());
+            reported[node_id] = node.is_terminal() ? 1 : 0;
+            output = node.output;
+        }
+        stats.num_patterns += reported[node_id];
+        if (linked && node_id != 0 && output != NO_NODE) {
+            reported[node_id] += reported[output];
+        }
+        stats.output_links += reported[node_id];
+        ++stats.num_nodes;
+        ++stats.fanout[children.size()];
+        stats.max_depth = std::max(stats.max_depth, depth);
+        for (const auto& child : children) {
+            Q.push_back(std::make_pair(child.second, depth + 1));
+        }
+    }
+    if (!read_only) {
+        size_t transitions = 0;
+        for (const CppNode& node : nodes) {
+            transitions += node.outs.size();
+        }
+        // a transition is a node of a red-black tree with a header of 4 words
+        stats.memory["nodes"] = nodes.capacity() * sizeof(CppNode) +
+                                transitions * (sizeof(std::pair<SymbolId, NodeId>) + 4 * sizeof(void*));
+        stats.memory["fail_links"] = (fail_table.capacity() + fail_first.capacity() + fail_next.capacity() +
+                                      fail_prev.capacity()) * sizeof(int);
+        stats.memory["symbols"] = symbols.bytes();
+        stats.memory["labels"] = labels.bytes();
+    }
+    if (dfa) {
+        stats.memory["dfa"] = dfa->bytes();
+    }
+    if (lookup) {
+        stats.memory["lookup"] = lookup->bytes();
+    }
+    if (is_multi_dictionary()) {
+        stats.memory["dictionaries"] = dictionaries.bytes();
+    }
+    stats.prefilter = prefilter.kernel_name();
+    stats.counters = counters.to_map();
+    return stats;
+}
+
+template <class SymbolAt>
+bool CppAutomaton::walk(const size_t length, SymbolAt symbol_at, LabelId& label) const {
+    if (lookup) {
+        return lookup->walk(length, symbol_at, label);
+    }
+    const bool read_only = is_read_only();
+    NodeId node_id = 0;
+    for (size_t i=0 ; i<length ; ++i) {
+        const SymbolId elem = symbol_at(i);
+        if (elem == NO_SYMBOL) {
+            return false;
+        }
+        node_id = read_only ? dfa->find_child(node_id, elem) : nodes[node_id].get_outnode(elem);
+        if (node_id == NO_NODE) {
+            return false;
+        }
+    }
+    label = read_only ? dfa->get_label(node_id) : nodes[node_id].value;
+    return true;
+}
+
+bool CppAutomaton::walk_pattern(const StringVector& pattern, LabelId& label) const {
+    if (get_case_fold() == CASE_FOLD_NONE) {
+        return walk(pattern.size(), [this, &pattern](const size_t i) { return folded_symbol(pattern[i]); }, label);
+    }
+    const StringVector folded = fold_pattern(pattern);
+    return walk(folded.size(), [this, &folded](const size_t i) { return folded_symbol(folded[i]); }, label);
+}
+
+bool CppAutomaton::walk_bytes(const char* pattern, const size_t size, LabelId& label) const {
+    if (!is_byte_mode()) {
+        throw std::runtime_error("ERROR! Bytes can only be looked up in byte mode!");
+    }
+    auto byte_at = [](const char* bytes) {
+        return [bytes](const size_t i) { return static_cast<SymbolId>(static_cast<unsigned char>(bytes[i])); };
+    };
+    const CppCaseFold case_fold = get_case_fold();
+    if (case_fold == CASE_FOLD_NONE) {
+        return walk(size, byte_at(pattern), label);
+    }
+    const std::string folded = cpp_case_fold(std::string(pattern, size), case_fold, true);
+    return walk(folded.size(), byte_at(folded.data()), label);
+}
+
+bool CppAutomaton::has_pattern(const StringVector& pattern) const {
+    return find_label(pattern) != NO_LABEL;
+}
+
+bool CppAutomaton::has_prefix(const StringVector& prefix) const {
+    LabelId label;
+    return walk_pattern(prefix, label);
+}
+
+bool CppAutomaton::has_prefix_bytes(const char* prefix, const size_t size) const {
+    LabelId label;
+    return walk_bytes(prefix, size, label);
+}
+
+LabelId CppAutomaton::find_label(const StringVector& pattern) const {
+    LabelId label = NO_LABEL;
+    return walk_pattern(pattern, label) ? label : NO_LABEL;
+}
+
+LabelId CppAutomaton::find_label_bytes(const char* pattern, const size_t size) const {
+    LabelId label = NO_LABEL;
+    return walk_bytes(pattern, size, label) ? label : NO_LABEL;
+}
+
+std::string CppAutomaton::get_value(const StringVector& pattern) const {
+    return get_label(find_label(pattern));
+}
+
+void CppAutomaton::build_lookup() {
+    std::unique_ptr<CppDoubleArray> array(new CppDoubleArray());
+    if (is_read_only()) {
+        array->build([this](const NodeId node_id, std::vector<std::pair<SymbolId, NodeId>>& children) {
+            dfa->get_children(node_id, children);
+        }, [this](const NodeId node_id) { return dfa->get_label(node_id); });
+    } else {
+        array->build([this](const NodeId node_id, std::vector<std::pair<SymbolId, NodeId>>& children) {
+            children.assign(nodes[node_id].outs.begin(), nodes[node_id].outs.end());
+        }, [this](const NodeId node_id) { return nodes[node_id].value; });
+    }
+    lookup = std::move(array);
+}
+
+NodeId CppAutomaton::goto_node(const NodeId node_id, const SymbolId elem) const {
+    const CppNode& node = this->nodes[node_id];
+    auto iter = node.outs.find(elem);
+    if (iter != node.outs.end()) {
+        return iter->second;
+    } else if (node_id == 0) {
+        return 0;
+    }
+    return NO_NODE;
+}
+
+// levels smaller than this are linked on one thread
+static const size_t PARALLEL_MIN_LEVEL = 4096;
+
+void CppAutomaton::update_automaton(const unsigned num_threads) {
+    if (is_read_only()) {
+        return; // a mapped automaton is always up to date
+    }
+    #ifdef ACA_DEBUG
+        std::cout << "updating automaton\n";
+    #endif
+    CppPhaseTimer timer(counters.update_ns);
+    // The fail node of a node is always less deep than the node, so the nodes are linked one depth
+    // at a time and the nodes of a depth can be linked in parallel. The output link of a node
+    // only needs the output link of its fail node, so it is set at the same time.
+    struct Edge {
+        NodeId parent_id;
+        SymbolId elem;
+        NodeId node_id;
+    };
+    IntVector fail_table(nodes.size(), 0);
+    std::vector<Edge> level, next_level;
+    nodes[0].output = NO_NODE;
+    for (auto iter = nodes[0].outs.begin() ; iter != nodes[0].outs.end() ; ++iter) {
+        level.push_back(Edge{0, iter->first, iter->second});
+    }
+    while (level.size() > 0) {
+        cpp_parallel_for(level.size(), level.size() < PARALLEL_MIN_LEVEL ? 1 : num_threads, [&](const size_t i) {
+            const Edge& edge = level[i];
+            NodeId fail_id = 0;
+            if (edge.parent_id != 0) {
+                NodeId fail_node_id = fail_table[edge.parent_id];
+                while (goto_node(fail_node_id, edge.elem) == NO_NODE) {
+                    fail_node_id = fail_table[fail_node_id];
+                }
+                fail_id = goto_node(fail_node_id, edge.elem);
+            }
+            #ifdef ACA_DEBUG
+                std::cout << "    node id " << edge.node_id << " with key " << symbols.get_symbol(edge.elem)
+                          << " fails to " << fail_id << "\n";
+            #endif
+            fail_table[edge.node_id] = fail_id;
+            const CppNode& fail_node = nodes[fail_id];
+            nodes[edge.node_id].output = (fail_id != 0 && fail_node.is_terminal()) ? fail_id : fail_node.output;
+        });
+        next_level.clear();
+        for (const Edge& edge : level) {
+            const CppNode& node = nodes[edge.node_id];
+            for (auto iter=node.outs.begin() ; iter != node.outs.end() ; ++iter) {
+                next_level.push_back(Edge{edge.node_id, iter->first, iter->second});
+            }
+        }
+        level.swap(next_level);
+    }
+    this->fail_table = fail_table;
+    this->link_fail_tree();
+    this->build_prefilter();
+    this->uptodate.store(true, std::memory_order_release);
+}
+
+void CppAutomaton::link_outputs() {
+    // breadth first, so that the fail node of a node is always linked before the node itself
+    std::deque<NodeId> Q;
+    nodes[0].output = NO_NODE;
+    Q.push_back(0);
+    while (Q.size() > 0) {
+        NodeId node_id = Q[0]; Q.pop_front();
+        for (auto iter=nodes[node_id].outs.begin() ; iter != nodes[node_id].outs.end() ; ++iter) {
+            const NodeId dest_id = iter->second;
+            const NodeId fail_id = fail_table[dest_id];
+            const CppNode& fail_node = nodes[fail_id];
+            nodes[dest_id].output = (fail_id != 0 && fail_node.is_terminal()) ? fail_id : fail_node.output;
+            Q.push_back(dest_id);
+        }
+    }
+}
+
+void CppAutomaton::build_prefilter() {
+    prefilter.reset(is_byte_mode(), get_case_fold());
+    if (is_read_only()) {
+        std::vector<std::pair<SymbolId, NodeId>> children;
+        dfa->get_children(0, children);
+        for (const auto& child : children) {
+            prefilter.add_symbol(child.first);
+        }
+    } else {
+        for (auto iter = nodes[0].outs.begin() ; iter != nodes[0].outs.end() ; ++iter) {
+            prefilter.add_symbol(iter->first);
+        }
+    }
+}
+
+void CppAutomaton::ensure_updated() {
+    if (!uptodate.load(std::memory_order_acquire)) {
+        std::lock_guard<std::mutex> lock(update_mutex);
+        if (!uptodate.load(std::memory_order_relaxed)) {
+            ACA_COUNT(counters.rebuilds, 1);
+            update_automaton();
+        }
+    }
+}
+
+void CppAutomaton::compile() {
+    if (is_read_only()) {
+        return;
+    }
+    ensure_updated();
+    #ifdef ACA_DEBUG
+        std::cout << "compiling automaton\n";
+    #endif
+    CppPhaseTimer timer(counters.compile_ns);
+    std::unique_ptr<CppDfa> compiled(new CppDfa());
+    if (is_multi_dictionary()) {
+        compiled->build(nodes, fail_table, symbols, dictionaries.encode_sets());
+    } else {
+        compiled->build(nodes, fail_table, symbols, labels.get_symbols());
+    }
+    compiled->set_flags(flags);
+    dfa = std::move(compiled);
+}
+
+MatchVector CppAutomaton::get_matches(const StringVector& text, const bool exclude_overlaps) {
+    return get_matches(encode_symbols(text), exclude_overlaps);
+}
+
+template <class Graph, class Iter, class Visitor>
+NodeId CppAutomaton::scan_matches(const Graph& graph, Iter first, Iter last, NodeId node_id, const long offset,
+                                  Visitor visit, CppScanCounter& counter) const {
+    const long size = last - first;
+    CppPrefilterState skip(prefilter);
+    for (long idx=0 ; idx<size ; ++idx) {
+        if (node_id == 0 && skip.is_active()) {
+            const long next = skip_to_candidate(prefilter, first, idx, size);
+            skip.update(next - idx);
+            counter.skip(next - idx);
+            if (next == size) {
+                break;
+            }
+            idx = next;
+        }
+        node_id = graph.next_state(node_id, to_symbol(first[idx]));
+        counter.transition();
+        #ifdef ACA_DEBUG
+            std::cout << "matching pos " << idx << " symbol " << to_symbol(first[idx]) << " with node " << node_id << std::endl;
+        #endif
+        // report the node itself and every terminal node on its output chain
+        NodeId match_id = graph.is_terminal(node_id) ? node_id : graph.get_output(node_id);
+        while (match_id != NO_NODE) {
+            const int start = offset + idx - graph.get_depth(match_id);
+            const int end = offset + idx + 1;
+            if (start < end) {
+                #ifdef ACA_DEBUG
+                    std::cout << "match " << start << " " << end << " label " << graph.get_label(match_id) << std::endl;
+                #endif
+                counter.match();
+                if (!visit(start, end, graph.get_label(match_id))) {
+                    return node_id;
+                }
+            }
+            match_id = graph.get_output(match_id);
+        }
+    }
+    return node_id;
+}
+
+template <class Iter, class Visitor>
+NodeId CppAutomaton::scan_matches(Iter first, Iter last, NodeId node_id, const long offset, Visitor visit) const {
+    CppScanCounter counter(counters);
+    if (dfa) {
+        return scan_matches(*dfa, first, last, node_id, offset, visit, counter);
+    }
+    return scan_matches(TrieGraph(*this, counter), first, last, node_id, offset, visit, counter);
+}
+
+template <class Visitor>
+NodeId CppAutomaton::scan_matches(const char* first, const char* last, NodeId node_id, const long offset,
+                                  Visitor visit) const {
+    const CppCaseFold case_fold = get_case_fold();
+    if (case_fold == CASE_FOLD_NONE) {
+        return scan_matches<const char*, Visitor>(first, last, node_id, offset, visit);
+    }
+    return scan_matches(CppFoldedBytes(first, last, first, case_fold), CppFoldedBytes(first, last, last, case_fold),
+                        node_id, offset, visit);
+}
+
+template <class Iter>
+NodeId CppAutomaton::collect_matches(Iter first, Iter last, NodeId node_id, const long offset,
+                                     MatchVector& matches) const {
+    return scan_matches(first, last, node_id, offset, [&matches](const int start, const int end, const LabelId label) {
+        matches.push_back(CppMatch(start, end, label));
+        return true;
+    });
+}
+
+template <class Graph, class Iter, class Visitor>
+void CppAutomaton::scan_leftmost(const Graph& graph, Iter first, Iter last, const CppMatchKind kind, Visitor visit,
+                                 CppScanCounter& counter) const {
+    // The state of the automaton is the longest suffix of the scanned text that is a prefix of
+    // some pattern, so no match can start before the first position of that suffix. The best
+    // match found so far is final as soon as that position moves past its start, then the scan
+    // starts again from the root at the end of the match. Fewer symbols than the longest pattern
+    // are read ahead, so each match costs at most that much scanning again.
+    const long size = last - first;
+    CppPrefilterState skip(prefilter);
+    long pos = 0;
+    while (pos < size) {
+        NodeId node_id = 0;
+        bool found = false;
+        int best_start = 0, best_end = 0;
+        LabelId best_label = NO_LABEL;
+        uint32_t best_rank = 0;
+        long idx = pos;
+        for ( ; idx<size ; ++idx) {
+            if (node_id == 0 && !found && skip.is_active()) {
+                const long next = skip_to_candidate(prefilter, first, idx, size);
+                skip.update(next - idx);
+                counter.skip(next - idx);
+                if (next == size) {
+                    break;
+                }
+                idx = next;
+            }
+            node_id = graph.next_state(node_id, to_symbol(first[idx]));
+            counter.transition();
+            if (found && idx - graph.get_depth(node_id) > best_start) {
+                break;
+            }
+            // the output chain goes from the longest match to the shortest one
+            for (NodeId match_id = graph.is_terminal(node_id) ? node_id : graph.get_output(node_id) ;
+                    match_id != NO_NODE ; match_id = graph.get_output(match_id)) {
+                const int start = idx - graph.get_depth(match_id);
+                const int end = idx + 1;
+                if (start >= end) {
+                    continue;
+                }
+                if (!found || start < best_start || (start == best_start && (kind == MATCH_LEFTMOST_LONGEST ?
+                        end > best_end : graph.get_rank(match_id) < best_rank))) {
+                    found = true;
+                    best_start = start;
+                    best_end = end;
+                    best_label = graph.get_label(match_id);
+                    best_rank = graph.get_rank(match_id);
+                }
+            }
+        }
+        if (!found) {
+            return;
+        }
+        #ifdef ACA_DEBUG
+            std::cout << "leftmost match " << best_start << " " << best_end << " label " << best_label << std::endl;
+        #endif
+        counter.match();
+        if (!visit(best_start, best_end, best_label)) {
+            return;
+        }
+        pos = best_end;
+    }
+}
+
+template <class Iter, class Visitor>
+void CppAutomaton::scan_leftmost(Iter first, Iter last, const CppMatchKind kind, Visitor visit) const {
+    CppScanCounter counter(counters);
+    if (dfa) {
+        scan_leftmost(*dfa, first, last, kind, visit, counter);
+    } else {
+        scan_leftmost(TrieGraph(*this, counter), first, last, kind, visit, counter);
+    }
+}
+
+template <class Visitor>
+void CppAutomaton::scan_leftmost(const char* first, const char* last, const CppMatchKind kind, Visitor visit) const {
+    const CppCaseFold case_fold = get_case_fold();
+    if (case_fold == CASE_FOLD_NONE) {
+        scan_leftmost<const char*, Visitor>(first, last, kind, visit);
+    } else {
+        scan_leftmost(CppFoldedBytes(first, last, first, case_fold), CppFoldedBytes(first, last, last, case_fold),
+                      kind, visit);
+    }
+}
+
+template <class Iter>
+void CppAutomaton::collect_matches(Iter first, Iter last, const CppMatchKind kind, MatchVector& matches,
+                                   const size_t max_matches) const {
+    auto collect = [&matches, max_matches](const int start, const int end, const LabelId label) {
+        matches.push_back(CppMatch(start, end, label));
+        return max_matches == 0 || matches.size() < max_matches;
+    };
+    if (kind != MATCH_LEFTMOST_LONGEST && kind != MATCH_LEFTMOST_FIRST) {
+        scan_matches(first, last, 0, 0, collect);
+    } else {
+        scan_leftmost(first, last, kind, collect);
+    }
+}
+
+// move the end of a part of a text to the next code point boundary, so that case folding sees whole
+// code points, tokens are always whole
+static inline long align_end(const char* first, long end, const long size) {
+    while (end < size && (static_cast<unsigned char>(first[end]) & 0xC0) == 0x80) {
+        ++end;
+    }
+    return end;
+}
+
+template <class Iter>
+static inline long align_end(const Iter, const long end, const long) {
+    return end;
+}
+
+// throw if the matches of kind can not be reported while they are found
+static void check_streaming_kind(const CppMatchKind kind) {
+    if (kind == MATCH_NO_OVERLAPS) {
+        throw std::runtime_error("ERROR! Overlaps can not be removed without collecting all the matches!");
+    }
+}
+
+template <class Iter>
+size_t CppAutomaton::visit_matches(Iter first, Iter last, const CppMatchKind kind, const CppMatchVisitor& visit,
+                                   const size_t max_matches) const {
+    check_streaming_kind(kind);
+    size_t count = 0;
+    auto counted = [&visit, &count, max_matches](const int start, const int end, const LabelId label) {
+        ++count;
+        return visit(start, end, label) && (max_matches == 0 || count < max_matches);
+    };
+    if (kind == MATCH_ALL) {
+        scan_matches(first, last, 0, 0, counted);
+    } else {
+        scan_leftmost(first, last, kind, counted);
+    }
+    return count;
+}
+
+template <class Iter>
+MatchVector CppAutomaton::next_matches(CppMatchCursor& cursor, Iter first, Iter last, const CppMatchKind kind,
+                                       const size_t batch) const {
+    check_streaming_kind(kind);
+    const long size = last - first;
+    const size_t limit = std::max<size_t>(batch, 1);
+    MatchVector matches;
+    if (kind == MATCH_ALL) {
+        // the matches of a part of the text, the state of the automaton carries over to the next part
+        while (matches.empty() && cursor.offset < size) {
+            const long end = align_end(first, std::min<long>(size, cursor.offset + limit), size);
+            cursor.node_id = collect_matches(first + cursor.offset, first + end, cursor.node_id, cursor.offset,
+                                             matches);
+            cursor.offset = end;
+        }
+    } else if (cursor.offset < size) {
+        // the leftmost scan starts from the root after every match, so it can stop after any of them
+        const long offset = cursor.offset;
+        scan_leftmost(first + offset, last, kind, [&matches, offset, limit](const int start, const int end,
+                                                                            const LabelId label) {
+            matches.push_back(CppMatch(offset + start, offset + end, label));
+            return matches.size() < limit;
+        });
+        cursor.offset = matches.size() == limit ? matches.back().get_end() : size;
+    }
+    return matches;
 }
 
-void CppAutomaton::add(const StringVector& pattern, const std::string& value) {
-    #ifdef ACA_DEBUG
-        std::cout << "adding pattern with value <" << value << "> where pattern is ";
-        for (const std::string& s : pattern) {
-            std::cout << s << " ";
-        }
-        std::cout << "\n";
-    #endif
-    NodePtr node = root;
-    NodePtr outnode;
-    const std::string* elem;
-    for (size_t depth=0 ; depth<pattern.size() ; ++depth) {
-        elem = &pattern[depth];
-        //alphabet.insert(*elem);
-        outnode = node->get_outnode(*elem);
-        if (outnode) {
-            node = outnode;
-        } else {
-            NodePtr newnode = std::make_shared<CppNode>(nodes.size(), depth);
-            node->set_outnode(*elem, newnode);
-            nodes.push_back(newnode);
-            node = newnode;
+MatchVector CppAutomaton::finish_matches(MatchVector& matches, const CppMatchKind kind) const {
+    if (kind == MATCH_LEFTMOST_LONGEST || kind == MATCH_LEFTMOST_FIRST) {
+        return matches; // found in order and without overlaps
+    }
+    CppPhaseTimer timer(counters.overlap_ns);
+    // sort the matches
+    std::sort(matches.begin(), matches.end(), [](const CppMatch& a, const CppMatch& b) {
+        if (a.get_start() == b.get_start()) {
+            return a.get_end() < b.get_end();
         }
+        return a.get_start() < b.get_start();
+    });
+    if (kind == MATCH_NO_OVERLAPS) {
+        MatchVector result = cpp_remove_overlaps(matches);
+        ACA_COUNT(counters.overlaps_removed, matches.size() - result.size());
+        return result;
     }
-    node->set_value(value);
-    node->add_match(node);
-    uptodate = false;
+    return matches;
 }
 
-NodePtr CppAutomaton::find_node(const StringVector& prefix) const {
-    NodePtr node = root;
-    NodePtr outnode;
-    for (size_t idx=0 ; idx<prefix.size() ; ++idx) {
-        outnode = node->get_outnode(prefix[idx]);
-        if (outnode) {
-            node = outnode;
-        } else {
-            return NodePtr();
+MatchVector CppAutomaton::split_dicts(const MatchVector& matches, const std::vector<bool>& active,
+                                      const CppMatchKind kind, IntVector& dicts, const size_t max_matches) const {
+    if (!is_multi_dictionary()) {
+        throw std::runtime_error("ERROR! The automaton has no dictionaries!");
+    }
+    if (kind != MATCH_ALL && kind != MATCH_NO_OVERLAPS) {
+        throw std::runtime_error("ERROR! The leftmost match kinds are not supported with dictionaries!");
+    }
+    // the matches of each active dictionary, ordered by their positions as the matches are
+    std::vector<MatchVector> by_dict(std::min(active.size(), num_dictionaries()));
+    for (const CppMatch& match : matches) {
+        for (const auto& entry : dictionaries.get_entries(match.get_label())) {
+            if (entry.first < by_dict.size() && active[entry.first]) {
+                by_dict[entry.first].push_back(CppMatch(match.get_start(), match.get_end(), entry.second));
+            }
+        }
+    }
+    std::vector<std::pair<CppMatch, DictId>> tagged;
+    for (DictId dict=0 ; dict<by_dict.size() ; ++dict) {
+        if (kind == MATCH_NO_OVERLAPS) {
+            by_dict[dict] = cpp_remove_overlaps(by_dict[dict]);
+        }
+        for (const CppMatch& match : by_dict[dict]) {
+            tagged.push_back(std::make_pair(match, dict));
+        }
+    }
+    // the dictionaries were added in order, so the stable sort keeps them ordered for the same position
+    std::stable_sort(tagged.begin(), tagged.end(), [](const std::pair<CppMatch, DictId>& a, const std::pair<CppMatch, DictId>& b) {
+        if (a.first.get_start() == b.first.get_start()) {
+            return a.first.get_end() < b.first.get_end();
         }
+        return a.first.get_start() < b.first.get_start();
+    });
+    if (max_matches > 0 && tagged.size() > max_matches) {
+        tagged.resize(max_matches);
+    }
+    MatchVector result;
+    result.reserve(tagged.size());
+    dicts.clear();
+    dicts.reserve(tagged.size());
+    for (const auto& match : tagged) {
+        result.push_back(match.first);
+        dicts.push_back(static_cast<int>(match.second));
     }
-    return node;
+    return result;
 }
 
-bool CppAutomaton::has_pattern(const StringVector& pattern) const {
-    NodePtr node = find_node(pattern);
-    return node && node->get_value() != "";
+MatchVector CppAutomaton::get_matches_dicts(const StringVector& text, const std::vector<bool>& active,
+                                            const CppMatchKind kind, IntVector& dicts, const size_t max_matches) {
+    return split_dicts(get_matches(text, MATCH_ALL), active, kind, dicts, max_matches);
 }
 
-bool CppAutomaton::has_prefix(const StringVector& prefix) const {
-    NodePtr node = find_node(prefix);
-    return node != NULL;
+MatchVector CppAutomaton::get_matches_dicts_bytes(const char* text, const size_t size, const std::vector<bool>& active,
+                                                  const CppMatchKind kind, bool utf8_offsets, IntVector& dicts,
+                                                  const size_t max_matches) {
+    return split_dicts(get_matches_bytes(text, size, MATCH_ALL, utf8_offsets), active, kind, dicts, max_matches);
 }
 
-std::string CppAutomaton::get_value(const StringVector& pattern) const {
-    NodePtr node = find_node(pattern);
-    return node ? node->get_value() : std::string("");
+// the match kind of the exclude_overlaps flag
+static inline CppMatchKind overlaps_kind(const bool exclude_overlaps) {
+    return exclude_overlaps ? MATCH_NO_OVERLAPS : MATCH_ALL;
 }
 
-NodePtr CppAutomaton::goto_node(const int node_id, const std::string& elem) {
-    NodePtr node = this->nodes[node_id];
-    auto iter = node->outs.find(elem);
-    if (iter != node->outs.end()) {
-        return iter->second;
-    } else if (node_id == 0) {
-        return this->root;
+MatchVector CppAutomaton::get_matches(const SymbolVector& text, const bool exclude_overlaps) {
+    return get_matches(text, overlaps_kind(exclude_overlaps));
+}
+
+MatchVector CppAutomaton::get_matches(const StringVector& text, const CppMatchKind kind, const size_t max_matches) {
+    return get_matches(encode_symbols(text), kind, max_matches);
+}
+
+MatchVector CppAutomaton::get_matches(const SymbolVector& text, const CppMatchKind kind, const size_t max_matches) {
+    MatchVector matches;
+    ensure_updated();
+    collect_matches(text.begin(), text.end(), kind, matches, max_matches);
+    return finish_matches(matches, kind);
+}
+
+MatchVector CppAutomaton::get_matches_bytes(const char* text, const size_t size, const bool exclude_overlaps,
+                                            const bool utf8_offsets) {
+    return get_matches_bytes(text, size, overlaps_kind(exclude_overlaps), utf8_offsets);
+}
+
+MatchVector CppAutomaton::get_matches_bytes(const char* text, const size_t size, const CppMatchKind kind,
+                                            const bool utf8_offsets, const size_t max_matches) {
+    if (!is_byte_mode()) {
+        throw std::runtime_error("ERROR! Bytes can only be matched in byte mode!");
     }
-    return NodePtr();
+    MatchVector matches;
+    ensure_updated();
+    collect_matches(text, text + size, kind, matches, max_matches);
+    if (utf8_offsets) {
+        cpp_utf8_offsets(text, size, matches);
+    }
+    return finish_matches(matches, kind);
 }
 
-void CppAutomaton::update_automaton() {
-    #ifdef ACA_DEBUG
-        std::cout << "updating automaton\n";
-    #endif
-    IntVector fail_table(nodes.size(), 0);
-    NodePtr root = this->root;
-    std::deque<int> Q;
-    for (auto iter = root->outs.begin() ; iter != root->outs.end() ; ++iter) {
-        Q.push_back(iter->second->node_id);
+size_t CppAutomaton::for_each_match(const SymbolVector& text, const CppMatchKind kind, const CppMatchVisitor& visit,
+                                    const size_t max_matches) {
+    ensure_updated();
+    return visit_matches(text.begin(), text.end(), kind, visit, max_matches);
+}
+
+size_t CppAutomaton::for_each_match_bytes(const char* text, const size_t size, const CppMatchKind kind,
+                                          const CppMatchVisitor& visit, const size_t max_matches) {
+    if (!is_byte_mode()) {
+        throw std::runtime_error("ERROR! Bytes can only be matched in byte mode!");
     }
-    while (Q.size() > 0) {
-        int node_id = Q[0]; Q.pop_front();
-        NodePtr node = nodes[node_id];
-        #ifdef ACA_DEBUG
-            std::cout << "processing node " << node_id << " value " << node->value << "\n";
-        #endif
-        for (auto iter=node->outs.begin() ; iter != node->outs.end() ; ++iter) {
-            auto dest_node = iter->second;
-            #ifdef ACA_DEBUG
-                std::cout << "    dest node id " << dest_node->node_id << " with key " << iter->first << "\n";
-            #endif
-            Q.push_back(dest_node->node_id);
-            int fail_node_id = fail_table[node_id];
-            while (goto_node(fail_node_id, iter->first) == NULL) {
-                fail_node_id = fail_table[fail_node_id];
-            }
-            fail_table[dest_node->node_id] = goto_node(fail_node_id, iter->first)->node_id;
-            // copy the matches
-            NodePtr fail_node = nodes[fail_table[dest_node->node_id]];
-            dest_node->matches.reserve(dest_node->matches.size() + fail_node->matches.size());
-            std::copy(fail_node->matches.begin(), fail_node->matches.end(), std::back_inserter(dest_node->matches));
-            #ifdef ACA_DEBUG
-                std::cout << "    dest node has " << dest_node->matches.size() << " matches\n";
-            #endif
+    ensure_updated();
+    return visit_matches(text, text + size, kind, visit, max_matches);
+}
+
+MatchVector CppAutomaton::next_matches(CppMatchCursor& cursor, const SymbolVector& text, const CppMatchKind kind,
+                                       const size_t batch) {
+    ensure_updated();
+    return next_matches(cursor, text.begin(), text.end(), kind, batch);
+}
+
+MatchVector CppAutomaton::next_matches_bytes(CppMatchCursor& cursor, const char* text, const size_t size,
+                                             const CppMatchKind kind, const size_t batch, const bool utf8_offsets) {
+    if (!is_byte_mode()) {
+        throw std::runtime_error("ERROR! Bytes can only be matched in byte mode!");
+    }
+    ensure_updated();
+    const long offset = cursor.offset;
+    MatchVector matches = next_matches(cursor, text, text + size, kind, batch);
+    if (utf8_offsets) {
+        // matches may start before the part scanned by this call
+        long first = offset;
+        for (const CppMatch& match : matches) {
+            first = std::min<long>(first, match.get_start());
         }
+        const int base = cursor.code_points - cpp_utf8_length(text + first, text + offset);
+        cpp_utf8_offsets(text, first, cursor.offset, base, matches);
+        cursor.code_points += cpp_utf8_length(text + offset, text + cursor.offset);
     }
-    this->fail_table = fail_table;
-    this->remove_duplicate_matches();
-    this->uptodate = true;
+    return matches;
+}
+
+std::vector<MatchVector> CppAutomaton::get_matches_batch(const std::vector<StringVector>& texts,
+                                                         const bool exclude_overlaps, const unsigned num_threads) {
+    return get_matches_batch(texts, overlaps_kind(exclude_overlaps), num_threads);
+}
+
+std::vector<MatchVector> CppAutomaton::get_matches_batch(const std::vector<StringVector>& texts,
+                                                         const CppMatchKind kind, const unsigned num_threads) {
+    // update once before fanning out, the threads only read the automaton
+    ensure_updated();
+    std::vector<MatchVector> results(texts.size());
+    cpp_parallel_for(texts.size(), num_threads, [&](const size_t i) {
+        const SymbolVector text = encode_symbols(texts[i]);
+        collect_matches(text.begin(), text.end(), kind, results[i]);
+        results[i] = finish_matches(results[i], kind);
+    });
+    return results;
+}
+
+std::vector<MatchVector> CppAutomaton::get_matches_bytes_batch(const StringVector& texts, const bool exclude_overlaps,
+                                                               const bool utf8_offsets, const unsigned num_threads) {
+    return get_matches_bytes_batch(texts, overlaps_kind(exclude_overlaps), utf8_offsets, num_threads);
+}
+
+std::vector<MatchVector> CppAutomaton::get_matches_bytes_batch(const StringVector& texts, const CppMatchKind kind,
+                                                               const bool utf8_offsets, const unsigned num_threads) {
+    if (!is_byte_mode()) {
+        throw std::runtime_error("ERROR! Bytes can only be matched in byte mode!");
+    }
+    ensure_updated();
+    std::vector<MatchVector> results(texts.size());
+    cpp_parallel_for(texts.size(), num_threads, [&](const size_t i) {
+        const std::string& text = texts[i];
+        collect_matches(text.data(), text.data() + text.size(), kind, results[i]);
+        if (utf8_offsets) {
+            cpp_utf8_offsets(text.data(), text.size(), results[i]);
+        }
+        results[i] = finish_matches(results[i], kind);
+    });
+    return results;
+}
+
+bool CppAutomaton::contains_any(const StringVector& text) {
+    const SymbolVector symbols = encode_symbols(text);
+    bool found = false;
+    ensure_updated();
+    scan_matches(symbols.begin(), symbols.end(), 0, 0, [&found](const int, const int, const LabelId) {
+        found = true;
+        return false;
+    });
+    return found;
+}
+
+bool CppAutomaton::contains_any_bytes(const char* text, const size_t size) {
+    if (!is_byte_mode()) {
+        throw std::runtime_error("ERROR! Bytes can only be matched in byte mode!");
+    }
+    bool found = false;
+    ensure_updated();
+    scan_matches(text, text + size, 0, 0, [&found](const int, const int, const LabelId) {
+        found = true;
+        return false;
+    });
+    return found;
+}
+
+template <class Iter>
+size_t CppAutomaton::count_matches(Iter first, Iter last) {
+    size_t count = 0;
+    ensure_updated();
+    scan_matches(first, last, 0, 0, [&count](const int, const int, const LabelId) {
+        ++count;
+        return true;
+    });
+    return count;
+}
+
+size_t CppAutomaton::count_matches(const StringVector& text, const bool exclude_overlaps) {
+    if (exclude_overlaps) {
+        return get_matches(text, true).size();
+    }
+    const SymbolVector symbols = encode_symbols(text);
+    return count_matches(symbols.begin(), symbols.end());
+}
+
+size_t CppAutomaton::count_matches_bytes(const char* text, const size_t size, const bool exclude_overlaps) {
+    if (!is_byte_mode()) {
+        throw std::runtime_error("ERROR! Bytes can only be matched in byte mode!");
+    }
+    if (exclude_overlaps) {
+        return get_matches_bytes(text, size, exclude_overlaps).size();
+    }
+    return count_matches(text, text + size);
+}
+
+template <class Iter>
+void CppAutomaton::count_labels(Iter first, Iter last, std::vector<size_t>& counts) {
+    ensure_updated();
+    counts.assign(num_labels(), 0);
+    scan_matches(first, last, 0, 0, [&counts](const int, const int, const LabelId label) {
+        ++counts[label];
+        return true;
+    });
 }
 
-void CppAutomaton::remove_duplicate_matches() {
-    for (int i=0 ; i<nodes.size() ; ++i) {
-        std::set<int> s;
-        for (int j=0 ; j<nodes[i]->matches.size() ; ++j) {
-            s.insert(nodes[i]->matches[j]->get_id());
+std::map<std::string, size_t> CppAutomaton::label_counts(const std::vector<size_t>& counts) const {
+    std::map<std::string, size_t> result;
+    for (size_t label=0 ; label<counts.size() ; ++label) {
+        if (counts[label] > 0) {
+            result[get_label(label)] = counts[label];
         }
-        nodes[i]->matches.clear();
-        for (auto j=s.begin() ; j != s.end() ; ++j) {
-            nodes[i]->matches.push_back(nodes[*j]);
+    }
+    return result;
+}
+
+std::map<std::string, size_t> CppAutomaton::count_by_label(const StringVector& text, const bool exclude_overlaps) {
+    std::vector<size_t> counts;
+    if (exclude_overlaps) {
+        counts.assign(num_labels(), 0);
+        for (const CppMatch& match : get_matches(text, true)) {
+            ++counts[match.get_label()];
         }
+    } else {
+        const SymbolVector symbols = encode_symbols(text);
+        count_labels(symbols.begin(), symbols.end(), counts);
     }
+    return label_counts(counts);
 }
 
-MatchVector CppAutomaton::get_matches(const StringVector& text, const bool exclude_overlaps) {
-    MatchVector matches;
-    if (!this->uptodate) {
-        this->update_automaton();
+std::map<std::string, size_t> CppAutomaton::count_by_label_bytes(const char* text, const size_t size,
+                                                                 const bool exclude_overlaps) {
+    if (!is_byte_mode()) {
+        throw std::runtime_error("ERROR! Bytes can only be matched in byte mode!");
     }
-    int node_id = this->root->node_id;
-    for (size_t idx=0 ; idx<text.size() ; ++idx) {
-        while (goto_node(node_id, text[idx]) == NULL) {
-            node_id = this->fail_table[node_id]; // follow fail
+    std::vector<size_t> counts;
+    if (exclude_overlaps) {
+        const MatchVector matches = get_matches_bytes(text, size, exclude_overlaps);
+        counts.assign(num_labels(), 0);
+        for (const CppMatch& match : matches) {
+            ++counts[match.get_label()];
         }
-        NodePtr node = goto_node(node_id, text[idx]);
-        node_id = node->node_id;
-        #ifdef ACA_DEBUG
-            std::cout << "matching pos " << idx << " " << text[idx] << " with node " << node->node_id << " value " << node->value << std::endl;
-        #endif
-        if (node->value != "") {
-            for (NodePtr resnode : node->matches) {
-                const int start = idx - resnode->depth;
-                const int end = idx + 1;
-                if (start < end) {
-                    #ifdef ACA_DEBUG
-                        std::cout << "adding match " << start << " " << end << std::endl;
-                    #endif
-                    matches.push_back(CppMatch(start, end, resnode->get_value()));
-                    #ifdef ACA_DEBUG
-                        std::cout << "  " << matches[matches.size()-1].str() << std::endl;
-                    #endif
-                }
-            }
+    } else {
+        count_labels(text, text + size, counts);
+    }
+    return label_counts(counts);
+}
+
+MatchVector CppAutomaton::feed(CppMatcherState& state, const StringVector& chunk) {
+    return feed(state, encode_symbols(chunk));
+}
+
+MatchVector CppAutomaton::feed(CppMatcherState& state, const SymbolVector& chunk) {
+    MatchVector matches;
+    ensure_updated();
+    state.node_id = collect_matches(chunk.begin(), chunk.end(), state.node_id, state.offset, matches);
+    state.offset += chunk.size();
+    return matches;
+}
+
+// the number of bytes of the UTF-8 sequence a lead byte starts
+static size_t utf8_sequence_length(const char lead) {
+    const unsigned char byte = static_cast<unsigned char>(lead);
+    return byte >= 0xF0 ? 4 : byte >= 0xE0 ? 3 : byte >= 0xC0 ? 2 : 1;
+}
+
+// the number of bytes at the end of a UTF-8 text that start a code point without completing it
+static size_t utf8_cut_off(const char* text, const size_t size) {
+    for (size_t count=1 ; count<=std::min<size_t>(size, 3) ; ++count) {
+        const char byte = text[size - count];
+        if ((static_cast<unsigned char>(byte) & 0xC0) != 0x80) {
+            return count < utf8_sequence_length(byte) ? count : 0;
         }
     }
-    // sort the matches
-    std::sort(matches.begin(), matches.end(), [](const CppMatch& a, const CppMatch& b) {
-        if (a.get_start() == b.get_start()) {
-            return a.get_end() < b.get_end();
+    return 0;
+}
+
+MatchVector CppAutomaton::feed_bytes(CppMatcherState& state, const char* chunk, const size_t size) {
+    if (!is_byte_mode()) {
+        throw std::runtime_error("ERROR! Bytes can only be matched in byte mode!");
+    }
+    MatchVector matches;
+    ensure_updated();
+    size_t done = 0;
+    if (!state.pending.empty()) {
+        // complete the code point cut off at the end of the last chunk, so that it is folded as a whole
+        std::string head = state.pending;
+        const size_t length = utf8_sequence_length(head[0]);
+        while (done < size && head.size() < length && (static_cast<unsigned char>(chunk[done]) & 0xC0) == 0x80) {
+            head += chunk[done++];
         }
-        return a.get_start() < b.get_start();
-    });
-    if (exclude_overlaps) {
-        return cpp_remove_overlaps(matches);
+        if (head.size() < length && done == size) {
+            state.pending = head;
+            return matches;
+        }
+        state.node_id = collect_matches(head.data(), head.data() + head.size(), state.node_id, state.offset, matches);
+        state.offset += head.size();
+        state.pending.clear();
     }
+    // the folded bytes of a code point are only known once all of its bytes have been fed
+    const size_t end = get_case_fold() == CASE_FOLD_UNICODE ? size - utf8_cut_off(chunk + done, size - done) : size;
+    state.node_id = collect_matches(chunk + done, chunk + end, state.node_id, state.offset, matches);
+    state.offset += end - done;
+    state.pending.assign(chunk + end, chunk + size);
     return matches;
 }
 
 std::string CppAutomaton::str() const {
-    return root->str();
+    std::stringstream ss;
+    __str(0, ss);
+    return ss.str();
 }
 
-KeyValueVector CppAutomaton::get_patterns_values() const {
-    KeyValueVector vec;
-    vec.reserve(this->nodes.size()); // ~approximate size
-    StringVector strvec;
-    this->__get_patterns_values(root, vec, strvec);
-    return vec;
+void CppAutomaton::__str(const NodeId node_id, std::ostream& os) const {
+    std::string indent;
+    for (int i=0 ; i<get_node_depth(node_id)+1 ; ++i) indent += "  ";
+    os << indent << "VALUE: <" << get_node_value(node_id) << ">\n";
+    for (auto& out : sorted_outs(node_id)) {
+        os << indent << out.first << "\n";
+        __str(out.second, os);
+    }
 }
 
-void CppAutomaton::__get_patterns_values(NodePtr node, KeyValueVector& vec, StringVector& strvec) const {
-    if (strvec.size() > 0 && node->get_value().size() > 0) {
-        vec.push_back(KeyValue(strvec, node->get_value()));
+std::vector<std::pair<std::string, NodeId>> CppAutomaton::sorted_outs(const NodeId node_id) const {
+    std::vector<std::pair<std::string, NodeId>> outs;
+    for (auto& child : sorted_children(node_id)) {
+        outs.push_back(std::make_pair(get_token(child.first), child.second));
+    }
+    return outs;
+}
+
+std::vector<std::pair<SymbolId, NodeId>> CppAutomaton::sorted_children(const NodeId node_id) const {
+    std::vector<std::pair<SymbolId, NodeId>> children;
+    if (is_read_only()) {
+        dfa->get_children(node_id, children);
+    } else {
+        const CppNode& node = nodes[node_id];
+        children.assign(node.outs.begin(), node.outs.end());
+    }
+    if (is_byte_mode()) {
+        // symbol id b is the byte b, strings compare their bytes as unsigned chars
+        std::sort(children.begin(), children.end());
+        return children;
     }
-    for (auto iter=node->outs.begin() ; iter != node->outs.end() ; ++iter) {
-        strvec.push_back(iter->first);
-        this->__get_patterns_values(iter->second, vec, strvec);
-        strvec.pop_back();
+    std::vector<std::pair<std::string, size_t>> tokens;
+    tokens.reserve(children.size());
+    for (size_t idx=0 ; idx<children.size() ; ++idx) {
+        tokens.push_back(std::make_pair(get_token(children[idx].first), idx));
     }
+    std::sort(tokens.begin(), tokens.end());
+    std::vector<std::pair<SymbolId, NodeId>> sorted;
+    sorted.reserve(children.size());
+    for (auto& token : tokens) {
+        sorted.push_back(children[token.second]);
+    }
+    return sorted;
+}
+
+std::string CppAutomaton::get_token(const SymbolId elem) const {
+    return is_read_only() ? dfa->get_symbol(elem) : symbols.get_symbol(elem);
+}
+
+KeyValueVector CppAutomaton::get_patterns_values() const {
+    CppTrieCursor cursor;
+    start_items(cursor, StringVector(), false);
+    return next_items(cursor, SIZE_MAX);
 }
 
 KeyValueVector CppAutomaton::get_prefixes_values() const {
-    KeyValueVector vec;
-    vec.reserve(this->nodes.size()*2); // ~approximate size
-    StringVector strvec;
-    this->__get_prefixes_values(root, vec, strvec);
-    return vec;
+    CppTrieCursor cursor;
+    start_items(cursor, StringVector(), true);
+    return next_items(cursor, SIZE_MAX);
+}
+
+void CppAutomaton::start_items(CppTrieCursor& cursor, const StringVector& prefix, const bool prefixes,
+        const size_t offset, const size_t limit) const {
+    cursor.path.clear();
+    cursor.key = fold_pattern(prefix);
+    cursor.prefixes = prefixes;
+    cursor.offset = offset;
+    cursor.limit = limit;
+    const NodeId node_id = find_node(prefix);
+    if (node_id != NO_NODE) {
+        push_trie_node(cursor, node_id);
+    }
+}
+
+void CppAutomaton::push_trie_node(CppTrieCursor& cursor, const NodeId node_id) const {
+    cursor.path.push_back(CppTrieCursor::Frame());
+    CppTrieCursor::Frame& frame = cursor.path.back();
+    frame.node_id = node_id;
+    frame.children = sorted_children(node_id);
+    frame.next = 0;
+    cursor.pending = true;
 }
 
-void CppAutomaton::__get_prefixes_values(NodePtr node, KeyValueVector& vec, StringVector& strvec) const {
-    vec.push_back(KeyValue(strvec, node->get_value()));
-    for (auto iter=node->outs.begin() ; iter != node->outs.end() ; ++iter) {
-        strvec.push_back(iter->first);
-        this->__get_prefixes_values(iter->second, vec, strvec);
-        strvec.pop_back();
+// check if the bytes of a prefix end in the middle of a UTF-8 sequence
+static bool inside_utf8(const StringVector& key) {
+    size_t continuation = 0;
+    for (auto iter=key.rbegin() ; iter != key.rend() ; ++iter) {
+        const unsigned char byte = iter->empty() ? 0 : static_cast<unsigned char>((*iter)[0]);
+        if ((byte & 0xC0) == 0x80) {
+            if (++continuation == 4) {
+                return false;
+            }
+            continue;
+        }
+        const size_t length = byte >= 0xF0 ? 4 : byte >= 0xE0 ? 3 : byte >= 0xC0 ? 2 : 1;
+        return continuation + 1 < length;
     }
+    return false;
 }
 
+KeyValueVector CppAutomaton::next_items(CppTrieCursor& cursor, const size_t count) const {
+    KeyValueVector items;
+    while (items.size() < count && !cursor.done()) {
+        CppTrieCursor::Frame& frame = cursor.path.back();
+        if (cursor.pending) {
+            cursor.pending = false;
+            std::string value = get_node_value(frame.node_id);
+            const bool report = cursor.prefixes
+                ? !(is_byte_mode() && inside_utf8(cursor.key))
+                : !cursor.key.empty() && !value.empty();
+            if (!report) {
+                continue;
+            }
+            if (cursor.offset > 0) {
+                --cursor.offset;
+                continue;
+            }
+            items.push_back(KeyValue(cursor.key, std::move(value)));
+            --cursor.limit;
+        } else if (frame.next < frame.children.size()) {
+            const std::pair<SymbolId, NodeId> child = frame.children[frame.next++];
+            cursor.key.push_back(get_token(child.first));
+            push_trie_node(cursor, child.second);
+        } else {
+            // the first node of the path stands for the prefix the iteration started with
+            if (cursor.path.size() > 1) {
+                cursor.key.pop_back();
+            }
+            cursor.path.pop_back();
+        }
+    }
+    return items;
+}
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // SERIALIZATION
@@ -253,13 +1717,18 @@ const std::string FAILTABLE_MARKER = "F";
 const std::string NODE_MARKER = "N";
 const std::string OUT_MARKER = "O";
 const std::string MATCHES_MARKER = "M";
+const std::string RANKS_MARKER = "R";
 
 void CppAutomaton::serialize_to_stream(std::ostream& os) {
-    if (!this->uptodate) {
-        this->update_automaton();
+    check_writable(); // the text format needs the keyword tree
+    ensure_updated();
+    // write generic information, the flags are only written when set to keep
+    // the format readable by older versions
+    os << AUTOMATON_MARKER << " " << nodes.size() << " " << uptodate.load();
+    if (flags != 0) {
+        os << " " << flags;
     }
-    // write generic information
-    os << AUTOMATON_MARKER << " " << nodes.size() << " " << uptodate << "\n";
+    os << "\n";
     // write fail table
     os << FAILTABLE_MARKER << " " << fail_table.size();
     for (int i=0 ; i<fail_table.size() ; ++i) {
@@ -267,28 +1736,37 @@ void CppAutomaton::serialize_to_stream(std::ostream& os) {
     }
     os << "\n";
     // write individual nodes
-    for (int i=0 ; i<nodes.size() ; ++i) {
+    for (size_t i=0 ; i<nodes.size() ; ++i) {
         #ifdef ACA_DEBUG
             std::cout << "Writing node " << i << "\n";
         #endif
-        NodePtr node = nodes[i];
-        if (node->node_id != i) {
-            std::cerr << "ERROR! node[" << i << "]->node_id = " << node->node_id << "\n";
-        }
-        os << NODE_MARKER << " " << node->node_id << " " << node->depth << " " << node->outs.size() << " ";
-        os << node->value << '\0';
+        const CppNode& node = nodes[i];
+        os << NODE_MARKER << " " << i << " " << node.depth << " " << node.outs.size() << " ";
+        os << get_label(node.value) << '\0';
         os << OUT_MARKER << " ";
-        for (auto j = node->outs.begin() ; j != node->outs.end() ; ++j) {
-            os << j->first << '\0';
-            os << j->second->node_id << " ";
+        for (auto j = node.outs.begin() ; j != node.outs.end() ; ++j) {
+            os << symbols.get_symbol(j->first) << '\0';
+            os << j->second << " ";
         }
-        os << MATCHES_MARKER << " " << node->matches.size();
-        for (int k=0 ; k<node->matches.size() ; ++k) {
+        // the matches of a node are its output chain, they are written out
+        // in full to keep the format readable by older versions
+        IntVector matches;
+        for (NodeId match_id = node.is_terminal() ? i : node.output ; match_id != NO_NODE ; match_id = nodes[match_id].output) {
+            matches.push_back(match_id);
+        }
+        os << MATCHES_MARKER << " " << matches.size();
+        for (size_t k=0 ; k<matches.size() ; ++k) {
             os << " ";
-            os << node->matches[k]->node_id;
+            os << matches[k];
         }
         os << " ";
     }
+    // the ranks of the patterns come last, so that older versions can ignore them
+    os << RANKS_MARKER << " " << nodes.size();
+    for (const CppNode& node : nodes) {
+        os << " " << node.rank;
+    }
+    os << "\n";
 }
 
 
@@ -308,15 +1786,27 @@ CppAutomaton* CppAutomaton::deserialize_from_stream(std::istream& is) {
     CppAutomaton* cppauto = new CppAutomaton();
 
     std::string tmpstr;
-    char tmpchr;
     long nnodes;
+    bool uptodate;
 
-    is >> tmpstr >> nnodes >> cppauto->uptodate;
+    is >> tmpstr >> nnodes >> uptodate;
+    cppauto->uptodate = uptodate;
     if (tmpstr != AUTOMATON_MARKER) {
         std::string err = "ERROR! Automaton marker not found!";
         std::cerr << err;
         throw new std::runtime_error(err);
     }
+    // the optional flags come before the fail table
+    is >> std::ws;
+    if (is.peek() != FAILTABLE_MARKER[0]) {
+        uint64_t flags = 0;
+        is >> flags;
+        if (flags & FLAG_BYTE_MODE) {
+            // intern the bytes before the symbols of the nodes, so that the ids are the bytes
+            cppauto->init_byte_mode();
+        }
+        cppauto->flags = flags;
+    }
     // read fail table
     is >> tmpstr >> nnodes;
     if (tmpstr != FAILTABLE_MARKER) {
@@ -334,21 +1824,16 @@ CppAutomaton* CppAutomaton::deserialize_from_stream(std::istream& is) {
     #endif
 
     // create nodes
-    cppauto->nodes.clear();
-    for (int i=0 ; i<nnodes ; ++i) {
-        #ifdef ACA_DEBUG
-            std::cout << "Creating node " << i << "\n"; std::cout.flush();
-        #endif
-        cppauto->nodes.push_back(std::make_shared<CppNode>(0, 0));
-    }
+    cppauto->nodes.assign(nnodes, CppNode(0));
     #ifdef ACA_DEBUG
         std::cout << "Nodes created!\n;"; std::cout.flush();
     #endif
     // prepare reading node
-    for (int i=0 ; i<cppauto->nodes.size() ; ++i) {
+    for (int i=0 ; i<nnodes ; ++i) {
         int outsize = 0;
-        NodePtr node = cppauto->nodes[i];
-        is >> tmpstr >> node->node_id >> node->depth >> outsize;
+        NodeId node_id = NO_NODE;
+        CppNode& node = cppauto->nodes[i];
+        is >> tmpstr >> node_id >> node.depth >> outsize;
         if (tmpstr != NODE_MARKER) {
             std::stringstream ss;
             ss << "ERROR! Node marker not found! Found <" << tmpstr << "> instead at byte " << is.tellg();
@@ -356,14 +1841,15 @@ CppAutomaton* CppAutomaton::deserialize_from_stream(std::istream& is) {
             throw new std::runtime_error(ss.str());
         }
         is.get(); // eat space char
-        std::getline(is, node->value, '\0');
+        std::getline(is, tmpstr, '\0');
+        node.value = cppauto->intern_value(tmpstr);
         #ifdef ACA_DEBUG
-            std::cout << "Read node " << node->node_id << "\n"; std::cout.flush();
+            std::cout << "Read node " << node_id << "\n"; std::cout.flush();
         #endif
 
-        if (node->node_id != i) {
+        if (node_id != i) {
             std::stringstream ss;
-            ss << "ERROR! Node id <" << node->node_id << "> for node <" << i << "> do not match!";
+            ss << "ERROR! Node id <" << node_id << "> for node <" << i << "> do not match!";
             std::cerr << ss.str();
             throw new std::runtime_error(ss.str());
         }
@@ -376,13 +1862,13 @@ CppAutomaton* CppAutomaton::deserialize_from_stream(std::istream& is) {
             std::cerr << ss.str();
             throw new std::runtime_error(ss.str());
         }
-        node->outs.clear();
+        node.outs.clear();
         for (int j=0 ; j<outsize ; ++j) {
             is.get(); // eat space char
             getline(is, tmpstr, '\0');
-            int destnode;
+            NodeId destnode;
             is >> destnode;
-            node->outs[tmpstr] = cppauto->nodes[destnode];
+            node.outs[cppauto->symbols.intern(tmpstr)] = destnode;
         }
         // read matches
         is >> tmpstr;
@@ -392,17 +1878,39 @@ CppAutomaton* CppAutomaton::deserialize_from_stream(std::istream& is) {
             std::cerr << ss.str();
             throw new std::runtime_error(ss.str());
         }
+        // the matches are rebuilt from the fail table as output links
         int matchsize;
         is >> matchsize;
         for (int j=0 ; j<matchsize ; ++j) {
             int matchid;
             is >> matchid;
-            node->matches.push_back(cppauto->nodes[matchid]);
         }
     }
-    cppauto->root = cppauto->nodes[0];
 
-    cppauto->remove_duplicate_matches();
+    // without ranks the patterns are ranked by their nodes, which were created in insertion order
+    is >> std::ws;
+    if (is.peek() == RANKS_MARKER[0]) {
+        is >> tmpstr >> nnodes;
+        if (nnodes != static_cast<long>(cppauto->nodes.size())) {
+            throw std::runtime_error("ERROR! The number of ranks does not match the number of nodes!");
+        }
+        for (CppNode& node : cppauto->nodes) {
+            is >> node.rank;
+        }
+    } else {
+        for (size_t i=0 ; i<cppauto->nodes.size() ; ++i) {
+            cppauto->nodes[i].rank = i;
+        }
+    }
+    for (const CppNode& node : cppauto->nodes) {
+        cppauto->next_rank = std::max(cppauto->next_rank, node.rank + 1);
+    }
+
+    if (cppauto->uptodate) {
+        cppauto->link_fail_tree();
+        cppauto->link_outputs();
+        cppauto->build_prefilter();
+    }
     return cppauto;
 }
 
@@ -418,4 +1926,231 @@ CppAutomaton* CppAutomaton::deserialize(const std::string serialized) {
     return deserialize_from_stream(ss);
 }
 
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// DELTAS
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+const std::string DELTA_MARKER = "D";
+const std::string PUT_MARKER = "P";
+const std::string ERASE_MARKER = "E";
+
+// the flags that change what is stored for the same patterns and values
+const uint64_t CONTENT_FLAGS = CppAutomaton::FLAG_BYTE_MODE | CppAutomaton::FLAG_ASCII_FOLD |
+                               CppAutomaton::FLAG_UNICODE_FOLD | CppAutomaton::FLAG_MULTI_DICT;
+
+// the finalizer of splitmix64, so that the sum of the hashes of the patterns is well mixed
+static uint64_t mix_hash(uint64_t h) {
+    h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
+    return h ^ (h >> 31);
+}
+
+uint64_t CppAutomaton::item_hash(const StringVector& pattern, const std::string& value) {
+    uint64_t h = mix_hash(pattern.size());
+    for (const std::string& token : pattern) {
+        h = mix_hash(h ^ CppFlatStrings::hash(token.data(), token.size()));
+    }
+    return mix_hash(h ^ CppFlatStrings::hash(value.data(), value.size()));
+}
+
+uint64_t CppAutomaton::content_hash() {
+    if (!hashed) {
+        // the patterns are summed up, so that a change only needs the hashes of the patterns it changes
+        uint64_t h = mix_hash(flags & CONTENT_FLAGS);
+        CppTrieCursor cursor;
+        start_items(cursor, StringVector(), false);
+        while (!cursor.done()) {
+            for (const KeyValue& item : next_items(cursor, 1024)) {
+                h += item_hash(item.first, item.second);
+            }
+        }
+        hash = h;
+        hashed = true;
+    }
+    return hash;
+}
+
+// the patterns of an automaton one at a time, in the order of their tokens
+class CppItemStream {
+private:
+    const CppAutomaton& automaton;
+    CppTrieCursor cursor;
+    KeyValueVector batch;
+    size_t index;
+public:
+    CppItemStream(const CppAutomaton& automaton) : automaton(automaton), index(0) {
+        automaton.start_items(cursor, StringVector(), false);
+        batch = automaton.next_items(cursor, 1024);
+    }
+    // the current pattern, nullptr at the end
+    const KeyValue* get() const { return index < batch.size() ? &batch[index] : nullptr; }
+    void next() {
+        if (++index == batch.size()) {
+            batch = automaton.next_items(cursor, 1024);
+            index = 0;
+        }
+    }
+};
+
+static void write_delta_item(std::ostream& os, const std::string& marker, const KeyValue& item) {
+    os << marker << " " << item.first.size() << " ";
+    for (const std::string& token : item.first) {
+        os << token << '\0';
+    }
+    if (marker == PUT_MARKER) {
+        os << item.second << '\0';
+    }
+}
+
+void CppAutomaton::serialize_delta_to_stream(CppAutomaton& base, std::ostream& os) {
+    if ((flags & CONTENT_FLAGS) != (base.flags & CONTENT_FLAGS)) {
+        throw std::runtime_error("ERROR! The automata have different byte modes or case foldings!");
+    }
+    // both automata give their patterns in the same order, so the changes are found in a single merge
+    std::stringstream changes;
+    size_t count = 0;
+    CppItemStream old_items(base);
+    CppItemStream new_items(*this);
+    while (old_items.get() || new_items.get()) {
+        const KeyValue* old_item = old_items.get();
+        const KeyValue* new_item = new_items.get();
+        if (new_item && (!old_item || new_item->first < old_item->first)) {
+            write_delta_item(changes, PUT_MARKER, *new_item);
+            new_items.next();
+            ++count;
+        } else if (!new_item || old_item->first < new_item->first) {
+            write_delta_item(changes, ERASE_MARKER, *old_item);
+            old_items.next();
+            ++count;
+        } else {
+            if (old_item->second != new_item->second) {
+                write_delta_item(changes, PUT_MARKER, *new_item);
+                ++count;
+            }
+            old_items.next();
+            new_items.next();
+        }
+    }
+    os << DELTA_MARKER << " " << base.content_hash() << " " << content_hash() << " " << count << "\n";
+    os << changes.rdbuf();
+}
+
+void CppAutomaton::serialize_delta_to(CppAutomaton& base, const std::string filename) {
+    std::ofstream fout(filename);
+    serialize_delta_to_stream(base, fout);
+    fout.close();
+}
+
+std::string CppAutomaton::serialize_delta(CppAutomaton& base) {
+    std::stringstream ss;
+    serialize_delta_to_stream(base, ss);
+    return ss.str();
+}
+
+size_t CppAutomaton::apply_delta_from_stream(std::istream& is) {
+    check_writable();
+    std::string marker;
+    uint64_t base_hash = 0, target_hash = 0;
+    size_t count = 0;
+    is >> marker >> base_hash >> target_hash >> count;
+    if (!is || marker != DELTA_MARKER) {
+        throw std::runtime_error("ERROR! Delta marker not found!");
+    }
+    if (base_hash != content_hash()) {
+        throw std::runtime_error("ERROR! The delta is for another version of the automaton!");
+    }
+    // read the whole delta and check the version it gives before changing anything
+    std::vector<std::pair<bool, KeyValue>> changes;
+    uint64_t h = hash;
+    while (changes.size() < count) {
+        changes.push_back(std::pair<bool, KeyValue>());
+        std::pair<bool, KeyValue>& change = changes.back();
+        size_t size = 0;
+        is >> marker >> size;
+        if (!is || (marker != PUT_MARKER && marker != ERASE_MARKER)) {
+            throw std::runtime_error("ERROR! Change marker not found in the delta!");
+        }
+        change.first = marker == PUT_MARKER;
+        StringVector& pattern = change.second.first;
+        is.get(); // eat space char
+        pattern.resize(size);
+        for (std::string& token : pattern) {
+            std::getline(is, token, '\0');
+        }
+        if (change.first) {
+            std::getline(is, change.second.second, '\0');
+        }
+        if (!is) {
+            throw std::runtime_error("ERROR! The delta is truncated!");
+        }
+        check_pattern(pattern);
+        const StringVector folded = fold_pattern(pattern);
+        const LabelId label = find_label(pattern);
+        if (label != NO_LABEL) {
+            h -= item_hash(folded, get_label(label));
+        }
+        if (change.first) {
+            h += item_hash(folded, change.second.second);
+        }
+    }
+    if (h != target_hash) {
+        throw std::runtime_error("ERROR! The delta does not give the version it was written for!");
+    }
+    for (const auto& change : changes) {
+        if (change.first) {
+            add(change.second.first, change.second.second);
+        } else {
+            remove(change.second.first);
+        }
+    }
+    hash = target_hash;
+    hashed = true;
+    return count;
+}
+
+size_t CppAutomaton::apply_delta_from(const std::string filename) {
+    std::ifstream fin(filename);
+    if (!fin) {
+        throw std::runtime_error("ERROR! Cannot open <" + filename + "> for reading!");
+    }
+    return apply_delta_from_stream(fin);
+}
+
+size_t CppAutomaton::apply_delta(const std::string& delta) {
+    std::stringstream ss(delta);
+    return apply_delta_from_stream(ss);
+}
+
+void CppAutomaton::save_mapped(const std::string filename) {
+    if (!is_read_only()) {
+        compile();
+    }
+    std::ofstream fout(filename, std::ios::binary);
+    if (!fout) {
+        throw std::runtime_error("ERROR! Cannot open <" + filename + "> for writing!");
+    }
+    dfa->save(fout);
+    fout.close();
+    if (!fout) {
+        throw std::runtime_error("ERROR! Cannot write <" + filename + ">!");
+    }
+}
+
+CppAutomaton* CppAutomaton::open_mapped(const std::string filename) {
+    std::unique_ptr<CppDfa> dfa(CppDfa::open_mapped(filename));
+    CppAutomaton* cppauto = new CppAutomaton();
+    cppauto->flags = dfa->get_flags();
+    cppauto->dfa = std::move(dfa);
+    cppauto->uptodate = true;
+    cppauto->build_prefilter();
+    // the sets get the label ids of the compiled automaton
+    if (cppauto->is_multi_dictionary()) {
+        for (LabelId label=1 ; label<cppauto->num_labels() ; ++label) {
+            cppauto->dictionaries.assign(NO_LABEL, CppDictionaryIndex::decode(cppauto->get_label(label)));
+        }
+    }
+    return cppauto;
+}
+
 END_NAMESPACE
@@ -20,51 +20,370 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #define AC__AUTOMATON_H
 
 #include "aca.h"
+#include "casefold.h"
+#include "symbols.h"
+#include "dfa.h"
+#include "dictionaries.h"
+#include "doublearray.h"
+#include "matcher.h"
+#include "prefilter.h"
+#include "stats.h"
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <map>
 #include <set>
 
 BEGIN_NAMESPACE(aca)
 
+// called with the start, end and label id of every match, returns false to stop the scan
+typedef std::function<bool(const int, const int, const LabelId)> CppMatchVisitor;
+
 class CppAutomaton {
 private:
-    NodePtr root;
-    //std::set<std::string> alphabet;
+    CppSymbolTable symbols;
+    // the values of the patterns, label id NO_LABEL is the empty value. The labels of
+    // a multi-dictionary automaton are the ids of the sets of its dictionaries instead.
+    CppSymbolTable labels;
     NodeVector nodes;
     IntVector fail_table;
-    bool uptodate;
+    // the fail links as a tree, each node is a child of its fail node. The children
+    // of a node are a doubly linked list, so that a node can move in constant time.
+    IntVector fail_first, fail_next, fail_prev;
+    std::unique_ptr<CppDfa> dfa;
+    // optional double-array trie for the lookups, see build_lookup
+    std::unique_ptr<CppDoubleArray> lookup;
+    // the sets of (dictionary id, value) pairs of a multi-dictionary automaton, see add_entry
+    CppDictionaryIndex dictionaries;
+    // set when the fail table and the output links match the nodes, matching
+    // threads check it without locking and update the automaton under update_mutex
+    std::atomic<bool> uptodate;
+    std::mutex update_mutex;
+    // FLAG_* options, fixed when the automaton is created
+    uint64_t flags;
+    // the rank of the next new pattern
+    uint32_t next_rank;
+    // the content hash of the patterns, valid when hashed is set, see content_hash
+    uint64_t hash;
+    bool hashed;
+    // skips the parts of a text that keep the automaton in the root, up to date with the root
+    // whenever uptodate is set
+    CppPrefilter prefilter;
+    // updated by the matching methods, which are otherwise const
+    mutable CppCounters counters;
+
+    // the keyword tree with the same interface as CppDfa, for the matching loops
+    struct TrieGraph;
+    // call visit(start, end, label) for the matches ending in text when starting from node_id, the position
+    // of the first symbol of text is offset. Stops when visit returns false.
+    // Returns the state after the last symbol scanned, the work done is counted in counter.
+    template <class Graph, class Iter, class Visitor>
+    NodeId scan_matches(const Graph& graph, Iter first, Iter last, NodeId node_id, const long offset,
+                        Visitor visit, CppScanCounter& counter) const;
+    // run scan_matches on the compiled automaton or the keyword tree
+    template <class Iter, class Visitor>
+    NodeId scan_matches(Iter first, Iter last, NodeId node_id, const long offset, Visitor visit) const;
+    // ... on the case folded bytes of a text if the automaton folds case
+    template <class Visitor>
+    NodeId scan_matches(const char* first, const char* last, NodeId node_id, const long offset,
+                        Visitor visit) const;
+    // scan_matches that adds the matches to a vector
+    template <class Iter>
+    NodeId collect_matches(Iter first, Iter last, NodeId node_id, const long offset, MatchVector& matches) const;
+    // call visit(start, end, label) for the leftmost non-overlapping matches of text, kind is
+    // MATCH_LEFTMOST_LONGEST or MATCH_LEFTMOST_FIRST. Stops when visit returns false. The symbols read
+    // ahead to finalize a match are scanned again, so it takes O(size + matches * longest pattern).
+    template <class Graph, class Iter, class Visitor>
+    void scan_leftmost(const Graph& graph, Iter first, Iter last, const CppMatchKind kind, Visitor visit,
+                       CppScanCounter& counter) const;
+    // run scan_leftmost on the compiled automaton or the keyword tree
+    template <class Iter, class Visitor>
+    void scan_leftmost(Iter first, Iter last, const CppMatchKind kind, Visitor visit) const;
+    template <class Visitor>
+    void scan_leftmost(const char* first, const char* last, const CppMatchKind kind, Visitor visit) const;
+    // add the matches of a text to a vector, only the leftmost ones for the leftmost kinds.
+    // Stops after max_matches matches unless it is 0.
+    template <class Iter>
+    void collect_matches(Iter first, Iter last, const CppMatchKind kind, MatchVector& matches,
+                         const size_t max_matches=0) const;
+    // see for_each_match and next_matches
+    template <class Iter>
+    size_t visit_matches(Iter first, Iter last, const CppMatchKind kind, const CppMatchVisitor& visit,
+                         const size_t max_matches) const;
+    template <class Iter>
+    MatchVector next_matches(CppMatchCursor& cursor, Iter first, Iter last, const CppMatchKind kind,
+                             const size_t batch) const;
+
+    // the count-only modes, see count_matches and count_by_label
+    template <class Iter>
+    size_t count_matches(Iter first, Iter last);
+    template <class Iter>
+    void count_labels(Iter first, Iter last, std::vector<size_t>& counts);
+    std::map<std::string, size_t> label_counts(const std::vector<size_t>& counts) const;
+
+    // sort the matches collected with collect_matches by their positions and remove the overlaps if needed
+    MatchVector finish_matches(MatchVector& matches, const CppMatchKind kind) const;
+    // split the matches of a multi-dictionary automaton by the active dictionaries, see get_matches_dicts
+    MatchVector split_dicts(const MatchVector& matches, const std::vector<bool>& active, const CppMatchKind kind,
+                            IntVector& dicts, const size_t max_matches) const;
+
+    // update the automaton if it has been modified, safe to call from several threads
+    void ensure_updated();
+    // set the candidates of the prefilter from the transitions of the root
+    void build_prefilter();
+
+    // throw if the automaton can not be modified
+    void check_writable() const;
+    // throw if the pattern can not be added to the automaton
+    void check_pattern(const StringVector& pattern) const;
+    // throw if the value can not be the value of a pattern
+    void check_value(const std::string& value) const;
+    // the label of a value, which replaces the set of dictionaries of label in a multi-dictionary automaton
+    LabelId intern_value(const std::string& value, const LabelId label=NO_LABEL);
+    // add the missing nodes of a pattern and return the node of the pattern
+    NodeId add_path(const StringVector& pattern);
+    // set the label of the node of a pattern added by add_path
+    void set_node_value(const NodeId node_id, const LabelId label);
+    // switch an empty automaton to byte mode
+    void init_byte_mode();
+    // fold the case of a pattern or a token as the automaton does
+    StringVector fold_pattern(const StringVector& pattern) const;
+    std::string fold_token(const std::string& token) const;
+    // get the symbol id of a token, NO_SYMBOL if it is unknown
+    SymbolId find_symbol(const std::string& token) const;
+    // ... of a token that has already been folded
+    SymbolId folded_symbol(const std::string& token) const;
+    // follow length symbols, given by symbol_at(i), from the root in the double array, the compiled
+    // automaton or the keyword tree. Returns false if they are not a prefix of any pattern, otherwise
+    // label is the label of the node reached.
+    template <class SymbolAt>
+    bool walk(const size_t length, SymbolAt symbol_at, LabelId& label) const;
+    bool walk_pattern(const StringVector& pattern, LabelId& label) const;
+    bool walk_bytes(const char* pattern, const size_t size, LabelId& label) const;
 protected:
-    NodePtr goto_node(const int node_id, const std::string& elem);
+    NodeId goto_node(const NodeId node_id, const SymbolId elem) const;
+
+    // node properties that work for both the keyword tree and a mapped automaton
+    int get_node_depth(const NodeId node_id) const;
+    std::string get_node_value(const NodeId node_id) const;
+
+    // set the output links of all nodes, fail_table must be up to date
+    void link_outputs();
+
+    // build the fail tree from fail_table
+    void link_fail_tree();
+    void fail_tree_attach(const NodeId node_id, const NodeId fail_id);
+    void fail_tree_detach(const NodeId node_id);
+
+    // incremental updates of an up to date automaton, see add
+    void link_new_node(const NodeId parent_id, const SymbolId elem, const NodeId node_id);
+    void relink_outputs(const NodeId node_id);
+    // take a pruned node out of the fail tree, the nodes failing to it fail to its fail node instead
+    void unlink_dead_node(const NodeId node_id);
+
+    // the part of the content hash contributed by a pattern, which has been case folded
+    static uint64_t item_hash(const StringVector& pattern, const std::string& value);
+
+    // get the outgoing transitions of a node, ordered by their tokens
+    std::vector<std::pair<std::string, NodeId>> sorted_outs(const NodeId node_id) const;
+    std::vector<std::pair<SymbolId, NodeId>> sorted_children(const NodeId node_id) const;
+    std::string get_token(const SymbolId elem) const;
+    void push_trie_node(CppTrieCursor& cursor, const NodeId node_id) const;
+    void __str(const NodeId node_id, std::ostream& os) const;
 public:
-    CppAutomaton();
+    // the symbols are the 256 byte values, so that plain strings can be matched
+    // without splitting them into tokens. Symbol id b is the byte b.
+    static const uint64_t FLAG_BYTE_MODE = 1;
+    // the case of the patterns and the texts is folded, see CppCaseFold
+    static const uint64_t FLAG_ASCII_FOLD = 2;
+    static const uint64_t FLAG_UNICODE_FOLD = 4;
+    // the Python layer does not normalize the tokens to NFC,
+    // the flag is only stored so that a loaded automaton works the same way
+    static const uint64_t FLAG_NO_NFC = 8;
+    // the value of each pattern is a set of (dictionary id, value) pairs, see add_entry
+    static const uint64_t FLAG_MULTI_DICT = 16;
+
+    CppAutomaton(bool byte_mode=false, CppCaseFold case_fold=CASE_FOLD_NONE, bool multi_dictionary=false);
 
-    // add a new pattern (key) and associate it with a value
+    bool is_byte_mode() const { return (flags & FLAG_BYTE_MODE) != 0; }
+    CppCaseFold get_case_fold() const;
+    bool is_nfc() const { return (flags & FLAG_NO_NFC) == 0; }
+    bool is_multi_dictionary() const { return (flags & FLAG_MULTI_DICT) != 0; }
+    void set_nfc(const bool nfc);
+
+    // add a new pattern (key) and associate it with a value.
+    // The tokens of the pattern must be single bytes in byte mode.
+    // Once the automaton has been updated, only the fail and output links
+    // affected by the new nodes are fixed, instead of rebuilding all of them.
     void add(const StringVector& pattern, const std::string& value);
 
+    // set the value of a pattern in one dictionary of a multi-dictionary automaton. The pattern is stored
+    // once for all the dictionaries, its set of values changes in place.
+    void add_entry(const StringVector& pattern, const DictId dict, const std::string& value);
+    // remove a pattern from one dictionary, and from the automaton if it is in no other dictionary.
+    // Returns false if the dictionary does not contain the pattern.
+    bool remove_entry(const StringVector& pattern, const DictId dict);
+    // one more than the largest dictionary id of a multi-dictionary automaton
+    size_t num_dictionaries() const { return dictionaries.num_dictionaries(); }
+
+    // add many patterns at once and update the automaton on num_threads threads (0 means one per core).
+    // An empty automaton builds the keyword tree from the sorted patterns, one thread per first symbol.
+    void build_from(const KeyValueVector& items, unsigned num_threads=0);
+
+    // remove a pattern and prune the nodes that are left without patterns.
+    // Returns false if the automaton does not contain the pattern. The pruned nodes
+    // are unreachable but keep their ids until compact is called.
+    bool remove(const StringVector& pattern);
+
+    // renumber the reachable nodes breadth first and free the space of the pruned nodes and of the
+    // values no pattern has any more. The label ids change, so earlier matches can not be decoded.
+    void compact();
+
+    // translate tokens to symbol ids, tokens unknown to the automaton become NO_SYMBOL
+    SymbolVector encode_symbols(const StringVector& tokens) const;
+
     // given a prefix pattern, find the node that represents it
-    NodePtr find_node(const StringVector& prefix) const;
+    NodeId find_node(const StringVector& prefix) const;
 
     // check if automaton contains the full pattern.
     bool has_pattern(const StringVector& pattern) const;
 
     // check if automaton contains the prefix.
     bool has_prefix(const StringVector& prefix) const;
+    // ... given as the bytes of a string in byte mode
+    bool has_prefix_bytes(const char* prefix, const size_t size) const;
 
-    // rebuild the automaton
-    void update_automaton();
+    // get the label id of the value of a pattern, NO_LABEL if the automaton does not contain it.
+    // Unlike get_value, the value is not copied, see get_label.
+    LabelId find_label(const StringVector& pattern) const;
+    LabelId find_label_bytes(const char* pattern, const size_t size) const;
 
-    void remove_duplicate_matches();
+    // build a double-array trie of the patterns that answers has_pattern, has_prefix, get_value and
+    // find_label with a single array probe per token, until the automaton is modified next time.
+    // It takes much less memory than the keyword tree, but is not used for matching.
+    void build_lookup();
+    bool has_lookup() const { return lookup != nullptr; }
+
+    // rebuild the automaton, the nodes of each depth are linked on num_threads threads
+    void update_automaton(unsigned num_threads=1);
+
+    // compile the automaton into a read-only DFA that is used for matching
+    // until the next modification of the automaton.
+    void compile();
+    bool is_compiled() const { return dfa != nullptr; }
+
+    // a mapped automaton has no keyword tree and can not be modified
+    bool is_read_only() const { return dfa && dfa->is_mapped(); }
 
     MatchVector get_matches(const StringVector& text, bool exclude_overlaps=true);
+    // match a text that has already been translated with encode_symbols
+    MatchVector get_matches(const SymbolVector& text, bool exclude_overlaps=true);
+    // match the bytes of a text in byte mode. The positions of the matches are byte offsets,
+    // or code point offsets of the UTF-8 text if utf8_offsets is set.
+    MatchVector get_matches_bytes(const char* text, const size_t size, bool exclude_overlaps=true,
+                                  bool utf8_offsets=false);
+    // get_matches with the overlaps resolved as given by kind. The leftmost kinds find the
+    // non-overlapping matches without collecting the overlapping ones, see scan_leftmost.
+    // Only the first max_matches matches found are kept unless it is 0, before the overlaps are removed.
+    MatchVector get_matches(const StringVector& text, const CppMatchKind kind, const size_t max_matches=0);
+    MatchVector get_matches(const SymbolVector& text, const CppMatchKind kind, const size_t max_matches=0);
+    MatchVector get_matches_bytes(const char* text, const size_t size, const CppMatchKind kind,
+                                  bool utf8_offsets=false, const size_t max_matches=0);
+
+    // get the matches of the dictionaries of a multi-dictionary automaton whose ids are set in active,
+    // in a single pass over the text. A pattern in several active dictionaries gives a match for each
+    // of them: its label is the entry id of the value, see get_entry_value, and dicts gets the dictionary
+    // id of every match. kind is MATCH_ALL or MATCH_NO_OVERLAPS, which removes the overlaps of each
+    // dictionary separately. The matches are ordered by their positions and dictionary ids, only the
+    // first max_matches are kept unless it is 0.
+    MatchVector get_matches_dicts(const StringVector& text, const std::vector<bool>& active, const CppMatchKind kind,
+                                  IntVector& dicts, const size_t max_matches=0);
+    MatchVector get_matches_dicts_bytes(const char* text, const size_t size, const std::vector<bool>& active,
+                                        const CppMatchKind kind, bool utf8_offsets, IntVector& dicts,
+                                        const size_t max_matches=0);
+    std::string get_entry_value(const LabelId entry) const { return dictionaries.get_value(entry); }
+
+    // call visit for the matches of a text as they are found, without collecting or sorting them.
+    // MATCH_ALL finds them in the order of their end positions, the leftmost kinds from left to right.
+    // MATCH_NO_OVERLAPS needs all the matches at once and is not supported. Stops when visit returns
+    // false or after max_matches matches unless it is 0, returns the number of matches visited.
+    size_t for_each_match(const SymbolVector& text, const CppMatchKind kind, const CppMatchVisitor& visit,
+                          const size_t max_matches=0);
+    size_t for_each_match_bytes(const char* text, const size_t size, const CppMatchKind kind,
+                                const CppMatchVisitor& visit, const size_t max_matches=0);
+
+    // get the next matches of a text from where cursor stopped, so that the matches can be iterated
+    // over in bounded memory. MATCH_ALL scans batch symbols at a time until it finds some matches,
+    // the leftmost kinds stop after batch matches. An empty result means that the text has no more
+    // matches, MATCH_NO_OVERLAPS is not supported.
+    MatchVector next_matches(CppMatchCursor& cursor, const SymbolVector& text, const CppMatchKind kind,
+                             const size_t batch);
+    MatchVector next_matches_bytes(CppMatchCursor& cursor, const char* text, const size_t size,
+                                   const CppMatchKind kind, const size_t batch, bool utf8_offsets=false);
+
+    // match many texts on num_threads threads (0 means one per core) and get the matches of each text.
+    // Matching only reads the automaton, so it can be shared by any number of threads as long as no
+    // patterns are added at the same time.
+    std::vector<MatchVector> get_matches_batch(const std::vector<StringVector>& texts, bool exclude_overlaps=true,
+                                               unsigned num_threads=0);
+    std::vector<MatchVector> get_matches_batch(const std::vector<StringVector>& texts, const CppMatchKind kind,
+                                               unsigned num_threads=0);
+    // match many texts in byte mode, see get_matches_bytes
+    std::vector<MatchVector> get_matches_bytes_batch(const StringVector& texts, bool exclude_overlaps=true,
+                                                     bool utf8_offsets=false, unsigned num_threads=0);
+    std::vector<MatchVector> get_matches_bytes_batch(const StringVector& texts, const CppMatchKind kind,
+                                                     bool utf8_offsets=false, unsigned num_threads=0);
+
+    // check if a text contains any pattern, stops at the first match
+    bool contains_any(const StringVector& text);
+    bool contains_any_bytes(const char* text, const size_t size);
+
+    // count the matches in a text without building them, unless overlaps have to be excluded
+    size_t count_matches(const StringVector& text, bool exclude_overlaps=false);
+    size_t count_matches_bytes(const char* text, const size_t size, bool exclude_overlaps=false);
+
+    // count the matches in a text by their values
+    std::map<std::string, size_t> count_by_label(const StringVector& text, bool exclude_overlaps=false);
+    std::map<std::string, size_t> count_by_label_bytes(const char* text, const size_t size,
+                                                       bool exclude_overlaps=false);
+
+    // feed the next chunk of a text to a streaming matcher and get the matches that end in the chunk.
+    // Matches can start in earlier chunks, their positions are relative to the start of the whole text
+    // and they are returned in the order of their end positions.
+    MatchVector feed(CppMatcherState& state, const StringVector& chunk);
+    MatchVector feed(CppMatcherState& state, const SymbolVector& chunk);
+    // feed a chunk of bytes in byte mode, the positions are byte offsets
+    MatchVector feed_bytes(CppMatcherState& state, const char* chunk, const size_t size);
+
+    // get the value a label id of a match stands for
+    std::string get_label(const LabelId label) const;
+    // the number of label ids in use
+    size_t num_labels() const;
+    // the number of nodes, pruned ones included until compact()
+    size_t num_nodes() const;
+
+    // get the structural statistics of the automaton and the hot path counters
+    CppStats get_stats() const;
+    void reset_counters() { counters.reset(); }
 
     // get the value of specified key.
     std::string get_value(const StringVector& pattern) const;
 
     // get all the patterns and their representive values in the automaton
     KeyValueVector get_patterns_values() const;
-    void __get_patterns_values(NodePtr node, KeyValueVector& vec, StringVector& strvec) const;
 
     // get all the patterns+prefixes and their representive values in the automaton
     KeyValueVector get_prefixes_values() const;
-    void __get_prefixes_values(NodePtr node, KeyValueVector& vec, StringVector& strvec) const;
+
+    // start iterating over the patterns that start with prefix, or over all their prefixes that are
+    // at least as long as prefix if prefixes is set, in the order of their tokens. The first offset
+    // items are skipped and at most limit items are returned. In byte mode the prefixes that end
+    // inside a UTF-8 sequence are left out.
+    void start_items(CppTrieCursor& cursor, const StringVector& prefix, const bool prefixes,
+        const size_t offset=0, const size_t limit=SIZE_MAX) const;
+    // get the next count items of an iteration, fewer only when it is done.
+    // The automaton must not be modified by remove or compact during the iteration.
+    KeyValueVector next_items(CppTrieCursor& cursor, const size_t count) const;
 
     // serialization
     void serialize_to(const std::string filename);
@@ -76,6 +395,30 @@ public:
     static CppAutomaton* deserialize_from(const std::string filename);
     static CppAutomaton* deserialize(const std::string serialized);
 
+    // a hash of the patterns, their values and the flags of the automaton, which does not depend on the
+    // order the patterns were added in, so that it identifies a version of a dictionary
+    uint64_t content_hash();
+
+    // write the patterns added to, changed in and removed from base to get this automaton,
+    // to be applied to automata with the content hash of base
+    void serialize_delta_to_stream(CppAutomaton& base, std::ostream& os);
+    void serialize_delta_to(CppAutomaton& base, const std::string filename);
+    std::string serialize_delta(CppAutomaton& base);
+
+    // apply a delta written by serialize_delta to an automaton with the content hash it was written for.
+    // Only the fail and output links affected by the changed patterns are updated. The automaton is not
+    // changed if the delta is for another version or does not give the expected version.
+    // Returns the number of patterns changed.
+    size_t apply_delta_from_stream(std::istream& is);
+    size_t apply_delta_from(const std::string filename);
+    size_t apply_delta(const std::string& delta);
+
+    // save the compiled automaton in a binary format that can be memory mapped
+    void save_mapped(const std::string filename);
+    // use a compiled automaton straight from a file saved with save_mapped,
+    // the result is read-only and shares its memory with other processes mapping the file
+    static CppAutomaton* open_mapped(const std::string filename);
+
     // print the structure of the automaton
     std::string str() const;
 };
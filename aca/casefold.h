@@ -0,0 +1,82 @@
+/*
+Aho-Corasick keyword tree + automaton implementation for Python.
+Copyright (C) 2016 Funderbeam OÜ ( tpetmanson@gmail.com )
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+#ifndef AC__CASEFOLD_H
+#define AC__CASEFOLD_H
+
+#include "aca.h"
+#include <cstddef>
+
+BEGIN_NAMESPACE(aca)
+
+// how an automaton folds the case of its patterns and of the texts it matches
+enum CppCaseFold {
+    CASE_FOLD_NONE = 0,
+    // A-Z to a-z
+    CASE_FOLD_ASCII = 1,
+    // Unicode simple case folding, every code point folds to a single code point
+    CASE_FOLD_UNICODE = 2
+};
+
+// fold a code point with Unicode simple case folding
+uint32_t cpp_fold_code_point(const uint32_t code_point);
+
+// fold the case of a UTF-8 string. With same_length, code points whose folded form has another
+// UTF-8 length are kept as they are, so that the folded string has the same byte offsets.
+// Invalid UTF-8 is copied as it is.
+std::string cpp_case_fold(const std::string& text, const CppCaseFold fold, const bool same_length);
+
+// Random access to the bytes of a UTF-8 text as they would be after cpp_case_fold with same_length,
+// so that a text can be matched without folding a copy of it. Code points cut off by the ends of
+// the text are not folded, see CppAutomaton::feed_bytes for texts fed in chunks.
+class CppFoldedBytes {
+private:
+    const char* begin;
+    const char* end;
+    const char* ptr;
+    CppCaseFold fold;
+    // the folded bytes of the last code point starting at cached_lead, cached_size is 0 if it was not folded
+    mutable const char* cached_lead;
+    mutable char cached[4];
+    mutable size_t cached_size;
+
+    char fold_multibyte(const char* byte) const;
+
+    char fold_byte(const char* byte) const {
+        const unsigned char b = static_cast<unsigned char>(*byte);
+        if (b < 0x80) {
+            return (b >= 'A' && b <= 'Z') ? static_cast<char>(b + ('a' - 'A')) : *byte;
+        }
+        return fold == CASE_FOLD_UNICODE ? fold_multibyte(byte) : *byte;
+    }
+public:
+    CppFoldedBytes(const char* begin, const char* end, const char* ptr, const CppCaseFold fold)
+        : begin(begin), end(end), ptr(ptr), fold(fold), cached_lead(nullptr), cached_size(0) { }
+
+    char operator*() const { return fold_byte(ptr); }
+    char operator[](const ptrdiff_t idx) const { return fold_byte(ptr + idx); }
+    CppFoldedBytes& operator++() { ++ptr; return *this; }
+    ptrdiff_t operator-(const CppFoldedBytes& other) const { return ptr - other.ptr; }
+    bool operator!=(const CppFoldedBytes& other) const { return ptr != other.ptr; }
+    // the original byte the iterator points to
+    const char* position() const { return ptr; }
+};
+
+END_NAMESPACE
+
+#endif
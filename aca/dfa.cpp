@@ -0,0 +1,360 @@
+/*
+Aho-Corasick keyword tree + automaton implementation for Python.
+Copyright (C) 2016 Funderbeam OÜ ( tpetmanson@gmail.com )
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+#include "dfa.h"
+#include "node.h"
+#include "symbols.h"
+
+#include <cstring>
+#include <ostream>
+#include <stdexcept>
+#include <unordered_map>
+
+BEGIN_NAMESPACE(aca)
+
+const size_t CppDfa::DENSE_MIN_FANOUT;
+const size_t CppDfa::DENSE_RATIO;
+
+CppDfa::CppDfa() : alphabet_size(0), flags(0) { }
+
+void CppDfa::build(const NodeVector& nodes, const IntVector& fail_table, const CppSymbolTable& symbols,
+                   const StringVector& labels) {
+    const size_t nstates = nodes.size();
+    const size_t alphabet_size = symbols.size();
+    this->alphabet_size = alphabet_size;
+
+    // visit the states breadth first, so that the row of the fail state
+    // is always complete before the rows of the states failing to it
+    IntVector order;
+    order.reserve(nstates);
+    order.push_back(0);
+    for (size_t i=0 ; i<order.size() ; ++i) {
+        const auto& outs = nodes[order[i]].get_outs();
+        for (auto iter=outs.begin() ; iter != outs.end() ; ++iter) {
+            order.push_back(iter->second);
+        }
+    }
+
+    // row(s) = outs(s) merged with row(fail(s)), where outs(s) take precedence.
+    // The root has an empty row as it is the fallback for every other state.
+    IntVector begins(nstates, 0);
+    IntVector sizes(nstates, 0);
+    SymbolVector symbol_buffer;
+    IntVector target_buffer;
+    for (size_t i=1 ; i<order.size() ; ++i) {
+        const int state = order[i];
+        const auto& outs = nodes[state].get_outs();
+        const int fail = fail_table[state];
+        begins[state] = static_cast<int>(symbol_buffer.size());
+        auto out = outs.begin();
+        int pos = begins[fail];
+        const int end = begins[fail] + sizes[fail];
+        while (out != outs.end() || pos < end) {
+            if (pos == end || (out != outs.end() && out->first <= symbol_buffer[pos])) {
+                if (pos < end && out->first == symbol_buffer[pos]) {
+                    ++pos;
+                }
+                symbol_buffer.push_back(out->first);
+                target_buffer.push_back(out->second);
+                ++out;
+            } else {
+                symbol_buffer.push_back(symbol_buffer[pos]);
+                target_buffer.push_back(target_buffer[pos]);
+                ++pos;
+            }
+        }
+        sizes[state] = static_cast<int>(symbol_buffer.size()) - begins[state];
+    }
+
+    // lay the rows out in state order
+    std::vector<uint32_t> row_offsets(nstates + 1, 0);
+    for (size_t state=0 ; state<nstates ; ++state) {
+        row_offsets[state + 1] = row_offsets[state] + sizes[state];
+    }
+    SymbolVector row_symbols(symbol_buffer.size());
+    std::vector<NodeId> row_targets(target_buffer.size());
+    for (size_t state=0 ; state<nstates ; ++state) {
+        std::copy(symbol_buffer.begin() + begins[state], symbol_buffer.begin() + begins[state] + sizes[state],
+                  row_symbols.begin() + row_offsets[state]);
+        std::copy(target_buffer.begin() + begins[state], target_buffer.begin() + begins[state] + sizes[state],
+                  row_targets.begin() + row_offsets[state]);
+    }
+    symbol_buffer = SymbolVector();
+    target_buffer = IntVector();
+
+    // the root row is always dense
+    std::vector<int32_t> dense_offsets(nstates, -1);
+    std::vector<NodeId> dense_targets(alphabet_size, 0);
+    dense_offsets[0] = 0;
+    const auto& root_outs = nodes[0].get_outs();
+    for (auto iter=root_outs.begin() ; iter != root_outs.end() ; ++iter) {
+        dense_targets[iter->first] = iter->second;
+    }
+    for (size_t state=1 ; state<nstates ; ++state) {
+        const size_t fanout = row_offsets[state + 1] - row_offsets[state];
+        if (fanout < DENSE_MIN_FANOUT || fanout * DENSE_RATIO < alphabet_size) {
+            continue;
+        }
+        const int32_t offset = static_cast<int32_t>(dense_targets.size());
+        dense_offsets[state] = offset;
+        dense_targets.resize(offset + alphabet_size);
+        std::copy(dense_targets.begin(), dense_targets.begin() + alphabet_size, dense_targets.begin() + offset);
+        for (uint32_t pos=row_offsets[state] ; pos<row_offsets[state + 1] ; ++pos) {
+            dense_targets[offset + row_symbols[pos]] = row_targets[pos];
+        }
+    }
+
+    // copy the information the matcher needs from the nodes
+    std::vector<int32_t> depths(nstates);
+    std::vector<NodeId> outputs(nstates);
+    std::vector<uint32_t> values(nstates);
+    std::vector<uint32_t> ranks(nstates);
+    for (size_t state=0 ; state<nstates ; ++state) {
+        const CppNode& node = nodes[state];
+        depths[state] = node.get_depth();
+        outputs[state] = node.get_output();
+        values[state] = node.get_value();
+        ranks[state] = node.get_rank();
+    }
+
+    this->row_offsets.assign(std::move(row_offsets));
+    this->row_symbols.assign(std::move(row_symbols));
+    this->row_targets.assign(std::move(row_targets));
+    this->dense_offsets.assign(std::move(dense_offsets));
+    this->dense_targets.assign(std::move(dense_targets));
+    this->depths.assign(std::move(depths));
+    this->fails.assign(std::vector<NodeId>(fail_table.begin(), fail_table.end()));
+    this->outputs.assign(std::move(outputs));
+    this->values.assign(std::move(values));
+    this->ranks.assign(std::move(ranks));
+    this->symbols.build(symbols.get_symbols(), true);
+    this->value_strings.build(labels, false);
+}
+
+size_t CppDfa::bytes() const {
+    return row_offsets.bytes() + row_symbols.bytes() + row_targets.bytes() + dense_offsets.bytes() +
+           dense_targets.bytes() + depths.bytes() + fails.bytes() + outputs.bytes() + values.bytes() +
+           ranks.bytes() + symbols.bytes() + value_strings.bytes();
+}
+
+void CppDfa::get_children(const NodeId state, std::vector<std::pair<SymbolId, NodeId>>& children) const {
+    children.clear();
+    if (state == 0) {
+        for (size_t symbol=0 ; symbol<alphabet_size ; ++symbol) {
+            if (dense_targets[symbol] != 0) {
+                children.push_back(std::make_pair(static_cast<SymbolId>(symbol), dense_targets[symbol]));
+            }
+        }
+        return;
+    }
+    for (uint32_t pos=row_offsets[state] ; pos<row_offsets[state + 1] ; ++pos) {
+        if (depths[row_targets[pos]] == depths[state] + 1) {
+            children.push_back(std::make_pair(row_symbols[pos], row_targets[pos]));
+        }
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// BINARY FORMAT
+//
+// The file starts with a fixed header and a table of sections, followed by
+// the sections themselves. Every section is an array aligned to 8 bytes, so
+// that it can be used in place once the file is mapped into memory. Numbers
+// are stored in the byte order of the machine that wrote the file.
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+const char MAPPED_MAGIC[8] = {'A', 'C', 'A', 'D', 'F', 'A', '\0', '\0'};
+// version 2 added the ranks section, version 1 files are still read
+const uint32_t MAPPED_VERSION = 2;
+const uint32_t MAPPED_BYTE_ORDER = 0x01020304;
+
+enum MappedSection {
+    SECTION_ROW_OFFSETS = 0,
+    SECTION_ROW_SYMBOLS,
+    SECTION_ROW_TARGETS,
+    SECTION_DENSE_OFFSETS,
+    SECTION_DENSE_TARGETS,
+    SECTION_DEPTHS,
+    SECTION_FAILS,
+    SECTION_OUTPUTS,
+    SECTION_VALUES,
+    SECTION_SYMBOL_CHARS,
+    SECTION_SYMBOL_OFFSETS,
+    SECTION_SYMBOL_SLOTS,
+    SECTION_VALUE_CHARS,
+    SECTION_VALUE_OFFSETS,
+    SECTION_RANKS,
+    SECTION_COUNT
+};
+
+struct MappedHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint64_t alphabet_size;
+    uint64_t nstates;
+    uint64_t flags;
+    uint64_t nsections;
+};
+
+struct MappedSectionEntry {
+    uint64_t offset;
+    uint64_t count;
+};
+
+static uint64_t align_offset(const uint64_t offset) {
+    return (offset + 7) & ~static_cast<uint64_t>(7);
+}
+
+// describes where a section comes from when writing and where it goes when reading
+struct MappedSectionData {
+    const void* data;
+    uint64_t count;
+    size_t itemsize;
+};
+
+template <typename T>
+static MappedSectionData section_data(const CppFlatArray<T>& array) {
+    MappedSectionData section = {array.data(), array.size(), sizeof(T)};
+    return section;
+}
+
+void CppDfa::save(std::ostream& os) const {
+    std::vector<MappedSectionData> sections(SECTION_COUNT);
+    sections[SECTION_ROW_OFFSETS] = section_data(row_offsets);
+    sections[SECTION_ROW_SYMBOLS] = section_data(row_symbols);
+    sections[SECTION_ROW_TARGETS] = section_data(row_targets);
+    sections[SECTION_DENSE_OFFSETS] = section_data(dense_offsets);
+    sections[SECTION_DENSE_TARGETS] = section_data(dense_targets);
+    sections[SECTION_DEPTHS] = section_data(depths);
+    sections[SECTION_FAILS] = section_data(fails);
+    sections[SECTION_OUTPUTS] = section_data(outputs);
+    sections[SECTION_VALUES] = section_data(values);
+    sections[SECTION_SYMBOL_CHARS] = section_data(symbols.get_chars());
+    sections[SECTION_SYMBOL_OFFSETS] = section_data(symbols.get_offsets());
+    sections[SECTION_SYMBOL_SLOTS] = section_data(symbols.get_slots());
+    sections[SECTION_VALUE_CHARS] = section_data(value_strings.get_chars());
+    sections[SECTION_VALUE_OFFSETS] = section_data(value_strings.get_offsets());
+    sections[SECTION_RANKS] = section_data(ranks);
+
+    MappedHeader header;
+    std::memcpy(header.magic, MAPPED_MAGIC, sizeof(header.magic));
+    header.version = MAPPED_VERSION;
+    header.byte_order = MAPPED_BYTE_ORDER;
+    header.alphabet_size = alphabet_size;
+    header.nstates = size();
+    header.flags = flags;
+    header.nsections = SECTION_COUNT;
+
+    std::vector<MappedSectionEntry> entries(SECTION_COUNT);
+    uint64_t offset = sizeof(MappedHeader) + SECTION_COUNT * sizeof(MappedSectionEntry);
+    for (size_t i=0 ; i<SECTION_COUNT ; ++i) {
+        offset = align_offset(offset);
+        entries[i].offset = offset;
+        entries[i].count = sections[i].count;
+        offset += sections[i].count * sections[i].itemsize;
+    }
+
+    os.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    os.write(reinterpret_cast<const char*>(entries.data()), entries.size() * sizeof(MappedSectionEntry));
+    uint64_t written = sizeof(MappedHeader) + SECTION_COUNT * sizeof(MappedSectionEntry);
+    const char padding[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+    for (size_t i=0 ; i<SECTION_COUNT ; ++i) {
+        os.write(padding, entries[i].offset - written);
+        const uint64_t nbytes = sections[i].count * sections[i].itemsize;
+        if (nbytes > 0) {
+            os.write(static_cast<const char*>(sections[i].data), nbytes);
+        }
+        written = entries[i].offset + nbytes;
+    }
+}
+
+template <typename T>
+static const T* mapped_section(const CppMappedFile& file, const MappedSectionEntry& entry) {
+    if (entry.offset % 8 != 0 || entry.offset > file.size() || entry.count > (file.size() - entry.offset) / sizeof(T)) {
+        throw std::runtime_error("ERROR! Corrupt section in mapped automaton!");
+    }
+    return reinterpret_cast<const T*>(file.data() + entry.offset);
+}
+
+CppDfa* CppDfa::open_mapped(const std::string& filename) {
+    std::shared_ptr<CppMappedFile> file = std::make_shared<CppMappedFile>(filename);
+    if (file->size() < sizeof(MappedHeader)) {
+        throw std::runtime_error("ERROR! <" + filename + "> is not a mapped automaton!");
+    }
+    const MappedHeader* header = reinterpret_cast<const MappedHeader*>(file->data());
+    if (std::memcmp(header->magic, MAPPED_MAGIC, sizeof(MAPPED_MAGIC)) != 0) {
+        throw std::runtime_error("ERROR! <" + filename + "> is not a mapped automaton!");
+    }
+    if (header->byte_order != MAPPED_BYTE_ORDER) {
+        throw std::runtime_error("ERROR! <" + filename + "> was written on a machine with a different byte order!");
+    }
+    // version 1 has all the sections before the ranks
+    const bool has_ranks = header->version == MAPPED_VERSION && header->nsections == SECTION_COUNT;
+    if (!has_ranks && !(header->version == 1 && header->nsections == SECTION_RANKS)) {
+        throw std::runtime_error("ERROR! Unsupported version of mapped automaton in <" + filename + ">!");
+    }
+    if (file->size() < sizeof(MappedHeader) + header->nsections * sizeof(MappedSectionEntry)) {
+        throw std::runtime_error("ERROR! <" + filename + "> is not a mapped automaton!");
+    }
+    const MappedSectionEntry* entries = reinterpret_cast<const MappedSectionEntry*>(file->data() + sizeof(MappedHeader));
+    const uint64_t nstates = header->nstates;
+    const uint64_t alphabet_size = header->alphabet_size;
+    if (nstates == 0
+            || entries[SECTION_ROW_OFFSETS].count != nstates + 1
+            || entries[SECTION_DENSE_OFFSETS].count != nstates
+            || entries[SECTION_DEPTHS].count != nstates
+            || entries[SECTION_FAILS].count != nstates
+            || entries[SECTION_OUTPUTS].count != nstates
+            || entries[SECTION_VALUES].count != nstates
+            || entries[SECTION_ROW_SYMBOLS].count != entries[SECTION_ROW_TARGETS].count
+            || entries[SECTION_DENSE_TARGETS].count < alphabet_size
+            || entries[SECTION_SYMBOL_OFFSETS].count != alphabet_size + 1
+            || entries[SECTION_VALUE_OFFSETS].count == 0
+            || (has_ranks && entries[SECTION_RANKS].count != nstates)) {
+        throw std::runtime_error("ERROR! Inconsistent section sizes in mapped automaton <" + filename + ">!");
+    }
+
+    std::unique_ptr<CppDfa> dfa(new CppDfa());
+    dfa->alphabet_size = alphabet_size;
+    dfa->flags = header->flags;
+    const MappedSectionEntry* e = entries;
+    dfa->row_offsets.view(mapped_section<uint32_t>(*file, e[SECTION_ROW_OFFSETS]), e[SECTION_ROW_OFFSETS].count);
+    dfa->row_symbols.view(mapped_section<SymbolId>(*file, e[SECTION_ROW_SYMBOLS]), e[SECTION_ROW_SYMBOLS].count);
+    dfa->row_targets.view(mapped_section<NodeId>(*file, e[SECTION_ROW_TARGETS]), e[SECTION_ROW_TARGETS].count);
+    dfa->dense_offsets.view(mapped_section<int32_t>(*file, e[SECTION_DENSE_OFFSETS]), e[SECTION_DENSE_OFFSETS].count);
+    dfa->dense_targets.view(mapped_section<NodeId>(*file, e[SECTION_DENSE_TARGETS]), e[SECTION_DENSE_TARGETS].count);
+    dfa->depths.view(mapped_section<int32_t>(*file, e[SECTION_DEPTHS]), e[SECTION_DEPTHS].count);
+    dfa->fails.view(mapped_section<NodeId>(*file, e[SECTION_FAILS]), e[SECTION_FAILS].count);
+    dfa->outputs.view(mapped_section<NodeId>(*file, e[SECTION_OUTPUTS]), e[SECTION_OUTPUTS].count);
+    dfa->values.view(mapped_section<uint32_t>(*file, e[SECTION_VALUES]), e[SECTION_VALUES].count);
+    dfa->symbols.view(mapped_section<char>(*file, e[SECTION_SYMBOL_CHARS]), e[SECTION_SYMBOL_CHARS].count,
+                      mapped_section<uint64_t>(*file, e[SECTION_SYMBOL_OFFSETS]), e[SECTION_SYMBOL_OFFSETS].count,
+                      mapped_section<uint32_t>(*file, e[SECTION_SYMBOL_SLOTS]), e[SECTION_SYMBOL_SLOTS].count);
+    dfa->value_strings.view(mapped_section<char>(*file, e[SECTION_VALUE_CHARS]), e[SECTION_VALUE_CHARS].count,
+                            mapped_section<uint64_t>(*file, e[SECTION_VALUE_OFFSETS]), e[SECTION_VALUE_OFFSETS].count,
+                            nullptr, 0);
+    if (has_ranks) {
+        dfa->ranks.view(mapped_section<uint32_t>(*file, e[SECTION_RANKS]), e[SECTION_RANKS].count);
+    }
+    dfa->file = file;
+    return dfa.release();
+}
+
+END_NAMESPACE
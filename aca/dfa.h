@@ -0,0 +1,133 @@
+/*
+Aho-Corasick keyword tree + automaton implementation for Python.
+Copyright (C) 2016 Funderbeam OÜ ( tpetmanson@gmail.com )
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+#ifndef AC__DFA_H
+#define AC__DFA_H
+
+#include "aca.h"
+#include "flat.h"
+#include "mapped.h"
+#include <algorithm>
+
+BEGIN_NAMESPACE(aca)
+
+// Read-only deterministic automaton compiled from the keyword tree and its
+// failure links, so that matching takes exactly one transition per input
+// symbol. States keep the ids of the trie nodes they were compiled from.
+//
+// A state only stores the transitions that differ from the transitions of the
+// root, everything else falls back to the dense root row. Rows are kept in a
+// CSR layout with the symbols of a state sorted, high-fanout states also get a
+// dense row of their own.
+//
+// All the data lives in flat arrays, so a compiled automaton can be saved in a
+// binary format and used straight from a memory mapped file.
+class CppDfa {
+private:
+    uint64_t alphabet_size;
+    // options of the automaton, stored as is in the binary format
+    uint64_t flags;
+    // transitions of state s are at [row_offsets[s], row_offsets[s+1])
+    CppFlatArray<uint32_t> row_offsets;
+    CppFlatArray<SymbolId> row_symbols;
+    CppFlatArray<NodeId> row_targets;
+    // offset of the dense row of a state in dense_targets or -1, the root row is at 0
+    CppFlatArray<int32_t> dense_offsets;
+    CppFlatArray<NodeId> dense_targets;
+    // per state information copied from the nodes
+    CppFlatArray<int32_t> depths;
+    CppFlatArray<NodeId> fails;
+    CppFlatArray<NodeId> outputs;
+    CppFlatArray<uint32_t> values;
+    // insertion ranks of the patterns, empty in files saved before they were added
+    CppFlatArray<uint32_t> ranks;
+    // symbol ids are indexes of this pool
+    CppFlatStrings symbols;
+    // values[s] is a label id, i.e. an index of this pool, NO_LABEL is the empty value
+    CppFlatStrings value_strings;
+    // keeps the memory of a mapped automaton alive
+    std::shared_ptr<CppMappedFile> file;
+public:
+    // states with at least this many transitions may get a dense row
+    static const size_t DENSE_MIN_FANOUT = 16;
+    // ... if their transitions cover at least 1/DENSE_RATIO of the alphabet
+    static const size_t DENSE_RATIO = 4;
+
+    CppDfa();
+
+    // compile the automaton, fail_table must be up to date with the nodes
+    void build(const NodeVector& nodes, const IntVector& fail_table, const CppSymbolTable& symbols,
+               const StringVector& labels);
+
+    // write the automaton in the binary format
+    void save(std::ostream& os) const;
+    // map an automaton saved in the binary format into memory
+    static CppDfa* open_mapped(const std::string& filename);
+    bool is_mapped() const { return file != nullptr; }
+
+    // get the state reached from state by reading symbol
+    NodeId next_state(const NodeId state, const SymbolId symbol) const {
+        if (symbol >= alphabet_size) {
+            return 0;
+        }
+        const int32_t dense = dense_offsets[state];
+        if (dense >= 0) {
+            return dense_targets[dense + symbol];
+        }
+        const SymbolId* first = row_symbols.begin() + row_offsets[state];
+        const SymbolId* last = row_symbols.begin() + row_offsets[state + 1];
+        const SymbolId* iter = std::lower_bound(first, last, symbol);
+        if (iter != last && *iter == symbol) {
+            return row_targets[iter - row_symbols.begin()];
+        }
+        return dense_targets[symbol];
+    }
+
+    // get the child of state in the keyword tree or NO_NODE
+    NodeId find_child(const NodeId state, const SymbolId symbol) const {
+        const NodeId next = next_state(state, symbol);
+        return (next != 0 && depths[next] == depths[state] + 1) ? next : NO_NODE;
+    }
+    // get the children of state in the keyword tree
+    void get_children(const NodeId state, std::vector<std::pair<SymbolId, NodeId>>& children) const;
+
+    int get_depth(const NodeId state) const { return depths[state]; }
+    NodeId get_fail(const NodeId state) const { return fails[state]; }
+    NodeId get_output(const NodeId state) const { return outputs[state]; }
+    bool is_terminal(const NodeId state) const { return values[state] != NO_LABEL; }
+    LabelId get_label(const NodeId state) const { return values[state]; }
+    // without ranks the patterns are ranked by their states, which were created in insertion order
+    uint32_t get_rank(const NodeId state) const { return ranks.size() > 0 ? ranks[state] : state; }
+    std::string get_value(const NodeId state) const { return value_strings.get(values[state]); }
+    std::string get_label_string(const LabelId label) const { return value_strings.get(label); }
+    size_t num_labels() const { return value_strings.size(); }
+
+    SymbolId find_symbol(const std::string& symbol) const { return symbols.find(symbol); }
+    std::string get_symbol(const SymbolId symbol) const { return symbols.get(symbol); }
+
+    size_t size() const { return depths.size(); }
+    // the bytes of all the arrays, mapped or not
+    size_t bytes() const;
+    size_t get_alphabet_size() const { return alphabet_size; }
+    uint64_t get_flags() const { return flags; }
+    void set_flags(const uint64_t flags) { this->flags = flags; }
+};
+
+END_NAMESPACE
+
+#endif
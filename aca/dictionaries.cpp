@@ -0,0 +1,142 @@
+/*
+Aho-Corasick keyword tree + automaton implementation for Python.
+Copyright (C) 2016 Funderbeam OÜ ( tpetmanson@gmail.com )
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+#include "dictionaries.h"
+#include <algorithm>
+#include <stdexcept>
+
+BEGIN_NAMESPACE(aca)
+
+// each pair is written as <dictionary id>:<size of value>:<value>
+std::string CppDictionaryIndex::encode(DictEntries entries) {
+    std::sort(entries.begin(), entries.end());
+    std::string label;
+    for (const auto& entry : entries) {
+        label += std::to_string(entry.first) + ":" + std::to_string(entry.second.size()) + ":" + entry.second;
+    }
+    return label;
+}
+
+// parse a decimal number ending at a colon
+static uint64_t parse_number(const std::string& label, size_t& pos) {
+    const size_t colon = label.find(':', pos);
+    if (colon == std::string::npos || colon == pos || colon - pos > 10) {
+        throw std::runtime_error("ERROR! The value is not a set of dictionary entries!");
+    }
+    uint64_t number = 0;
+    for ( ; pos < colon ; ++pos) {
+        if (label[pos] < '0' || label[pos] > '9') {
+            throw std::runtime_error("ERROR! The value is not a set of dictionary entries!");
+        }
+        number = number * 10 + (label[pos] - '0');
+    }
+    ++pos;
+    return number;
+}
+
+DictEntries CppDictionaryIndex::decode(const std::string& label) {
+    DictEntries entries;
+    size_t pos = 0;
+    while (pos < label.size()) {
+        const uint64_t dict = parse_number(label, pos);
+        const uint64_t size = parse_number(label, pos);
+        if (dict > UINT32_MAX || size > label.size() - pos) {
+            throw std::runtime_error("ERROR! The value is not a set of dictionary entries!");
+        }
+        entries.push_back(std::make_pair(static_cast<DictId>(dict), label.substr(pos, size)));
+        pos += size;
+    }
+    return entries;
+}
+
+LabelId CppDictionaryIndex::assign(LabelId set, const DictEntries& entries) {
+    if (set == NO_LABEL) {
+        set = static_cast<LabelId>(sets.size());
+        sets.emplace_back();
+    }
+    EntrySet& entry_set = sets[set];
+    entry_set.clear();
+    for (const auto& entry : entries) {
+        entry_set.push_back(std::make_pair(entry.first, values.intern(entry.second)));
+        num_dicts = std::max(num_dicts, static_cast<size_t>(entry.first) + 1);
+    }
+    std::sort(entry_set.begin(), entry_set.end());
+    return set;
+}
+
+LabelId CppDictionaryIndex::set_entry(LabelId set, const DictId dict, const std::string& value) {
+    if (set == NO_LABEL) {
+        set = static_cast<LabelId>(sets.size());
+        sets.emplace_back();
+    }
+    EntrySet& entry_set = sets[set];
+    const LabelId entry = values.intern(value);
+    auto iter = std::lower_bound(entry_set.begin(), entry_set.end(), std::make_pair(dict, NO_LABEL));
+    if (iter != entry_set.end() && iter->first == dict) {
+        iter->second = entry;
+    } else {
+        entry_set.insert(iter, std::make_pair(dict, entry));
+    }
+    num_dicts = std::max(num_dicts, static_cast<size_t>(dict) + 1);
+    return set;
+}
+
+bool CppDictionaryIndex::remove_entry(const LabelId set, const DictId dict) {
+    EntrySet& entry_set = sets[set];
+    auto iter = std::lower_bound(entry_set.begin(), entry_set.end(), std::make_pair(dict, NO_LABEL));
+    if (iter == entry_set.end() || iter->first != dict) {
+        return false;
+    }
+    entry_set.erase(iter);
+    return true;
+}
+
+DictEntries CppDictionaryIndex::get_set(const LabelId set) const {
+    DictEntries entries;
+    for (const auto& entry : sets[set]) {
+        entries.push_back(std::make_pair(entry.first, values.get_symbol(entry.second)));
+    }
+    return entries;
+}
+
+StringVector CppDictionaryIndex::encode_sets() const {
+    StringVector encoded;
+    encoded.reserve(sets.size());
+    for (LabelId set=0 ; set<sets.size() ; ++set) {
+        encoded.push_back(encode_set(set));
+    }
+    return encoded;
+}
+
+void CppDictionaryIndex::clear() {
+    sets.assign(1, EntrySet());
+    values.clear();
+    // entry id 0 is the empty value, as for the labels
+    values.intern("");
+    num_dicts = 0;
+}
+
+size_t CppDictionaryIndex::bytes() const {
+    size_t size = values.bytes() + sets.capacity() * sizeof(sets[0]);
+    for (const auto& entries : sets) {
+        size += entries.capacity() * sizeof(entries[0]);
+    }
+    return size;
+}
+
+END_NAMESPACE
@@ -0,0 +1,75 @@
+/*
+Aho-Corasick keyword tree + automaton implementation for Python.
+Copyright (C) 2016 Funderbeam OÜ ( tpetmanson@gmail.com )
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+#ifndef AC__DICTIONARIES_H
+#define AC__DICTIONARIES_H
+
+#include "aca.h"
+#include "symbols.h"
+
+BEGIN_NAMESPACE(aca)
+
+// the (dictionary id, value) pairs of a pattern in a multi-dictionary automaton
+typedef std::vector<std::pair<DictId, std::string>> DictEntries;
+
+// the (dictionary id, entry id) pairs of a pattern ordered by dictionary id
+typedef std::vector<std::pair<DictId, LabelId>> EntrySet;
+
+// The value of a pattern in a multi-dictionary automaton is the id of its set of (dictionary id, value)
+// pairs. Each pattern owns its set, so adding or removing an entry changes the set in place, and the values
+// of the dictionaries are interned once as entry ids. The sets are encoded as strings only for the file
+// formats and the compiled automaton, the set ids are the label ids of the compiled automaton.
+class CppDictionaryIndex {
+private:
+    // set 0 is the empty set of the nodes without a value
+    std::vector<EntrySet> sets;
+    CppSymbolTable values;
+    // one more than the largest dictionary id
+    size_t num_dicts;
+public:
+    CppDictionaryIndex() : num_dicts(0) { clear(); }
+
+    // encode the pairs as a label, the dictionary ids must be unique
+    static std::string encode(DictEntries entries);
+    // decode a label made by encode, throws if it was not
+    static DictEntries decode(const std::string& label);
+
+    // replace the pairs of a set, a new set is made for NO_LABEL, returns the set
+    LabelId assign(LabelId set, const DictEntries& entries);
+    // set the value of a dictionary in a set, a new set is made for NO_LABEL, returns the set
+    LabelId set_entry(LabelId set, const DictId dict, const std::string& value);
+    // returns false if the set has no value in the dictionary
+    bool remove_entry(const LabelId set, const DictId dict);
+    void clear_set(const LabelId set) { EntrySet().swap(sets[set]); }
+    DictEntries get_set(const LabelId set) const;
+    std::string encode_set(const LabelId set) const { return encode(get_set(set)); }
+    // the encoded sets by set id
+    StringVector encode_sets() const;
+    void clear();
+
+    const EntrySet& get_entries(const LabelId set) const { return sets[set]; }
+    const std::string& get_value(const LabelId entry) const { return values.get_symbol(entry); }
+    size_t num_sets() const { return sets.size(); }
+    size_t num_dictionaries() const { return num_dicts; }
+    // approximate bytes used by the index
+    size_t bytes() const;
+};
+
+END_NAMESPACE
+
+#endif
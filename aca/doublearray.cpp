@@ -0,0 +1,120 @@
+/*
+Aho-Corasick keyword tree + automaton implementation for Python.
+Copyright (C) 2016 Funderbeam OÜ ( tpetmanson@gmail.com )
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+#include "doublearray.h"
+#include <algorithm>
+#include <deque>
+
+BEGIN_NAMESPACE(aca)
+
+const int32_t CppDoubleArray::EMPTY;
+
+// a free slot that did not fit this many nodes in a row is no longer tried as the first child of a node
+static const int MAX_FAILURES = 16;
+
+void CppDoubleArray::build(const ChildrenFunction& children, const LabelFunction& label) {
+    units.assign(1, Unit{0, 0, label(0)});
+    alphabet_size = 0;
+    // the free slots that are tried for the first child of a node, as a doubly linked list in slot order
+    std::vector<int32_t> next_free(1, EMPTY), prev_free(1, EMPTY);
+    std::vector<int> failures(1, 0);
+    int32_t head = EMPTY, tail = EMPTY;
+    auto unlink = [&](const int32_t slot) {
+        if (prev_free[slot] != EMPTY) {
+            next_free[prev_free[slot]] = next_free[slot];
+        } else if (head == slot) {
+            head = next_free[slot];
+        } else {
+            return; // not in the list
+        }
+        if (next_free[slot] != EMPTY) {
+            prev_free[next_free[slot]] = prev_free[slot];
+        } else {
+            tail = prev_free[slot];
+        }
+        next_free[slot] = prev_free[slot] = EMPTY;
+    };
+    auto grow = [&](const size_t size) {
+        for (size_t slot=units.size() ; slot<size ; ++slot) {
+            units.push_back(Unit{0, EMPTY, NO_LABEL});
+            next_free.push_back(EMPTY);
+            prev_free.push_back(tail);
+            failures.push_back(0);
+            if (tail != EMPTY) {
+                next_free[tail] = slot;
+            } else {
+                head = slot;
+            }
+            tail = slot;
+        }
+    };
+
+    // breadth first, a node is placed with all of its siblings when its parent is processed
+    std::deque<std::pair<NodeId, int32_t>> Q;
+    std::vector<std::pair<SymbolId, NodeId>> outs;
+    Q.push_back(std::make_pair(0, 0));
+    while (Q.size() > 0) {
+        const NodeId node_id = Q[0].first;
+        const int32_t slot = Q[0].second;
+        Q.pop_front();
+        children(node_id, outs);
+        if (outs.empty()) {
+            continue;
+        }
+        std::sort(outs.begin(), outs.end());
+        alphabet_size = std::max(alphabet_size, outs.back().first + 1);
+        const size_t first_code = outs.front().first + 1;
+        const size_t last_code = outs.back().first + 1;
+        // find a base where all the children fit, starting from the free slots for the first child
+        size_t base = 0;
+        bool found = false;
+        for (int32_t free = head ; free != EMPTY && !found ; ) {
+            const int32_t next = next_free[free];
+            if (static_cast<size_t>(free) >= first_code) {
+                base = free - first_code;
+                found = true;
+                for (const auto& out : outs) {
+                    const size_t child = base + out.first + 1;
+                    if (child < units.size() && units[child].check != EMPTY) {
+                        found = false;
+                        break;
+                    }
+                }
+                if (!found && ++failures[free] >= MAX_FAILURES) {
+                    unlink(free);
+                }
+            }
+            free = next;
+        }
+        if (!found) {
+            base = std::max(units.size(), first_code) - first_code;
+        }
+        grow(base + last_code + 1);
+        units[slot].base = static_cast<int32_t>(base);
+        for (const auto& out : outs) {
+            const int32_t child = static_cast<int32_t>(base + out.first + 1);
+            unlink(child);
+            units[child].check = slot;
+            units[child].label = label(out.second);
+            Q.push_back(std::make_pair(out.second, child));
+        }
+    }
+    units.shrink_to_fit();
+}
+
+END_NAMESPACE
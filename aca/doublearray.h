@@ -0,0 +1,81 @@
+/*
+Aho-Corasick keyword tree + automaton implementation for Python.
+Copyright (C) 2016 Funderbeam OÜ ( tpetmanson@gmail.com )
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+#ifndef AC__DOUBLEARRAY_H
+#define AC__DOUBLEARRAY_H
+
+#include "aca.h"
+#include <functional>
+
+BEGIN_NAMESPACE(aca)
+
+// Read-only double-array trie of the keyword tree for looking up patterns and prefixes.
+// The child of slot s by symbol c is slot base[s] + c + 1 if its check is s, so every
+// token of a lookup costs a single probe of one array instead of a search of the
+// transitions of a node. The root is slot 0 and every slot has the label of its node.
+class CppDoubleArray {
+private:
+    struct Unit {
+        int32_t base;
+        // the parent slot, or EMPTY if the slot is free
+        int32_t check;
+        LabelId label;
+    };
+    std::vector<Unit> units;
+    // symbols from this on have no transitions
+    SymbolId alphabet_size;
+public:
+    static const int32_t EMPTY = -1;
+    // the children of a node of the tree as (symbol, node) pairs ordered by symbol
+    typedef std::function<void(const NodeId, std::vector<std::pair<SymbolId, NodeId>>&)> ChildrenFunction;
+    // the label of a node of the tree
+    typedef std::function<LabelId(const NodeId)> LabelFunction;
+
+    CppDoubleArray() : alphabet_size(0) { }
+
+    // build the double array of the tree of nodes reachable from node 0
+    void build(const ChildrenFunction& children, const LabelFunction& label);
+
+    // follow length symbols, given by symbol_at(i), from the root. Returns false if they are not
+    // a prefix of any pattern, otherwise label is the label of the slot reached.
+    template <class SymbolAt>
+    bool walk(const size_t length, SymbolAt symbol_at, LabelId& label) const {
+        int32_t slot = 0;
+        for (size_t i=0 ; i<length ; ++i) {
+            const SymbolId symbol = symbol_at(i);
+            if (symbol >= alphabet_size) {
+                return false;
+            }
+            const size_t next = static_cast<size_t>(units[slot].base) + symbol + 1;
+            if (next >= units.size() || units[next].check != slot) {
+                return false;
+            }
+            slot = static_cast<int32_t>(next);
+        }
+        label = units[slot].label;
+        return true;
+    }
+
+    // the number of slots, free ones included
+    size_t size() const { return units.size(); }
+    size_t bytes() const { return units.capacity() * sizeof(Unit); }
+};
+
+END_NAMESPACE
+
+#endif
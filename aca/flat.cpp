@@ -0,0 +1,95 @@
+/*
+Aho-Corasick keyword tree + automaton implementation for Python.
+Copyright (C) 2016 Funderbeam OÜ ( tpetmanson@gmail.com )
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+#include "flat.h"
+
+#include <cstring>
+#include <stdexcept>
+
+BEGIN_NAMESPACE(aca)
+
+uint64_t CppFlatStrings::hash(const char* str, const size_t len) {
+    uint64_t h = 14695981039346656037ULL;
+    for (size_t i=0 ; i<len ; ++i) {
+        h ^= static_cast<unsigned char>(str[i]);
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+void CppFlatStrings::build(const StringVector& strings, const bool with_index) {
+    std::vector<uint64_t> offsets;
+    offsets.reserve(strings.size() + 1);
+    offsets.push_back(0);
+    for (const std::string& str : strings) {
+        offsets.push_back(offsets.back() + str.size());
+    }
+    std::vector<char> chars;
+    chars.reserve(offsets.back());
+    for (const std::string& str : strings) {
+        chars.insert(chars.end(), str.begin(), str.end());
+    }
+    std::vector<uint32_t> slots;
+    if (with_index) {
+        // keep the load factor at or below 1/2
+        size_t nslots = 2;
+        while (nslots < strings.size() * 2) {
+            nslots *= 2;
+        }
+        slots.assign(nslots, 0);
+        for (size_t idx=0 ; idx<strings.size() ; ++idx) {
+            size_t slot = hash(strings[idx].data(), strings[idx].size()) & (nslots - 1);
+            while (slots[slot] != 0) {
+                slot = (slot + 1) & (nslots - 1);
+            }
+            slots[slot] = static_cast<uint32_t>(idx + 1);
+        }
+    }
+    this->chars.assign(std::move(chars));
+    this->offsets.assign(std::move(offsets));
+    this->slots.assign(std::move(slots));
+}
+
+void CppFlatStrings::view(const char* chars, const size_t nchars, const uint64_t* offsets, const size_t noffsets,
+                          const uint32_t* slots, const size_t nslots) {
+    if (nslots & (nslots - 1)) {
+        throw std::runtime_error("ERROR! Size of string index must be a power of two!");
+    }
+    this->chars.view(chars, nchars);
+    this->offsets.view(offsets, noffsets);
+    this->slots.view(slots, nslots);
+}
+
+SymbolId CppFlatStrings::find(const char* str, const size_t len) const {
+    const size_t nslots = slots.size();
+    if (nslots == 0) {
+        return NO_SYMBOL;
+    }
+    size_t slot = hash(str, len) & (nslots - 1);
+    while (slots[slot] != 0) {
+        const size_t idx = slots[slot] - 1;
+        const size_t begin = offsets[idx];
+        if (offsets[idx + 1] - begin == len && std::memcmp(chars.data() + begin, str, len) == 0) {
+            return static_cast<SymbolId>(idx);
+        }
+        slot = (slot + 1) & (nslots - 1);
+    }
+    return NO_SYMBOL;
+}
+
+END_NAMESPACE
@@ -0,0 +1,99 @@
+/*
+Aho-Corasick keyword tree + automaton implementation for Python.
+Copyright (C) 2016 Funderbeam OÜ ( tpetmanson@gmail.com )
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+#ifndef AC__FLAT_H
+#define AC__FLAT_H
+
+#include "aca.h"
+
+BEGIN_NAMESPACE(aca)
+
+// Read-only contiguous array that either owns its elements or points into
+// memory owned by someone else, e.g. a memory mapped file.
+template <typename T>
+class CppFlatArray {
+private:
+    std::vector<T> storage;
+    const T* ptr;
+    size_t count;
+public:
+    CppFlatArray() : ptr(nullptr), count(0) { }
+    CppFlatArray(const CppFlatArray&) = delete;
+    CppFlatArray& operator=(const CppFlatArray&) = delete;
+
+    // take over the elements of a vector
+    void assign(std::vector<T>&& values) {
+        storage = std::move(values);
+        ptr = storage.data();
+        count = storage.size();
+    }
+
+    // refer to elements that are owned by someone else
+    void view(const T* values, const size_t size) {
+        storage = std::vector<T>();
+        ptr = values;
+        count = size;
+    }
+
+    const T& operator[](const size_t idx) const { return ptr[idx]; }
+    const T* data() const { return ptr; }
+    const T* begin() const { return ptr; }
+    const T* end() const { return ptr + count; }
+    size_t size() const { return count; }
+    // the bytes of the elements, whether they are owned or not
+    size_t bytes() const { return count * sizeof(T); }
+};
+
+// Read-only pool of strings referred to by their index. The pool can be
+// indexed with an open addressing hash table to look strings up by content.
+// Hashes are computed with FNV-1a, so that they are stable across processes.
+class CppFlatStrings {
+private:
+    CppFlatArray<char> chars;
+    // string i is at [offsets[i], offsets[i+1])
+    CppFlatArray<uint64_t> offsets;
+    // index + 1 of the string hashed to the slot or 0 for an empty slot
+    CppFlatArray<uint32_t> slots;
+public:
+    static uint64_t hash(const char* str, const size_t len);
+
+    // build the pool, strings are indexed only if with_index is set
+    void build(const StringVector& strings, const bool with_index);
+
+    // refer to the arrays of a pool that is stored elsewhere
+    void view(const char* chars, const size_t nchars, const uint64_t* offsets, const size_t noffsets,
+              const uint32_t* slots, const size_t nslots);
+
+    // get the index of a string or NO_SYMBOL if it is not in the pool (or the pool is not indexed)
+    SymbolId find(const char* str, const size_t len) const;
+    SymbolId find(const std::string& str) const { return find(str.data(), str.size()); }
+
+    std::string get(const size_t idx) const {
+        return std::string(chars.data() + offsets[idx], offsets[idx + 1] - offsets[idx]);
+    }
+    size_t size() const { return offsets.size() > 0 ? offsets.size() - 1 : 0; }
+    size_t bytes() const { return chars.bytes() + offsets.bytes() + slots.bytes(); }
+
+    const CppFlatArray<char>& get_chars() const { return chars; }
+    const CppFlatArray<uint64_t>& get_offsets() const { return offsets; }
+    const CppFlatArray<uint32_t>& get_slots() const { return slots; }
+};
+
+END_NAMESPACE
+
+#endif
@@ -0,0 +1,58 @@
+/*
+Aho-Corasick keyword tree + automaton implementation for Python.
+Copyright (C) 2016 Funderbeam OÜ ( tpetmanson@gmail.com )
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+#include "mapped.h"
+
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+BEGIN_NAMESPACE(aca)
+
+CppMappedFile::CppMappedFile(const std::string& filename) : ptr(nullptr), length(0) {
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("ERROR! Cannot open <" + filename + ">");
+    }
+    struct stat st;
+    if (::fstat(fd, &st) != 0) {
+        ::close(fd);
+        throw std::runtime_error("ERROR! Cannot stat <" + filename + ">");
+    }
+    length = static_cast<size_t>(st.st_size);
+    if (length > 0) {
+        void* addr = ::mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+        if (addr == MAP_FAILED) {
+            ::close(fd);
+            throw std::runtime_error("ERROR! Cannot map <" + filename + "> into memory");
+        }
+        ptr = static_cast<const char*>(addr);
+    }
+    // the mapping stays valid after closing the descriptor
+    ::close(fd);
+}
+
+CppMappedFile::~CppMappedFile() {
+    if (ptr != nullptr) {
+        ::munmap(const_cast<char*>(ptr), length);
+    }
+}
+
+END_NAMESPACE
@@ -0,0 +1,44 @@
+/*
+Aho-Corasick keyword tree + automaton implementation for Python.
+Copyright (C) 2016 Funderbeam OÜ ( tpetmanson@gmail.com )
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+#ifndef AC__MAPPED_H
+#define AC__MAPPED_H
+
+#include "aca.h"
+
+BEGIN_NAMESPACE(aca)
+
+// A file mapped read-only into memory. The pages are shared with every other
+// process that maps the same file.
+class CppMappedFile {
+private:
+    const char* ptr;
+    size_t length;
+public:
+    CppMappedFile(const std::string& filename);
+    ~CppMappedFile();
+    CppMappedFile(const CppMappedFile&) = delete;
+    CppMappedFile& operator=(const CppMappedFile&) = delete;
+
+    const char* data() const { return ptr; }
+    size_t size() const { return length; }
+};
+
+END_NAMESPACE
+
+#endif
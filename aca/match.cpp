@@ -22,12 +22,12 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <sstream>
 #include <functional>
 #include <algorithm>
+#include <limits>
 
 
 BEGIN_NAMESPACE(aca)
 
-CppMatch::CppMatch(const int start, const int end, const std::string& label) : start(start), end(end), label(label) { }
-CppMatch::CppMatch(const int start, const int end, const char* label) : start(start), end(end), label(label) { }
+CppMatch::CppMatch(const int start, const int end, const LabelId label) : start(start), end(end), label(label) { }
 
 bool CppMatch::operator==(const CppMatch& m) const {
     return start == m.start && end == m.end;
@@ -59,7 +59,7 @@ void CppMatch::set_end(const int end) {
     this->end = end;
 }
 
-void CppMatch::set_label(const std::string& label) {
+void CppMatch::set_label(const LabelId label) {
     this->label = label;
 }
 
@@ -73,10 +73,9 @@ std::string CppMatch::str() const {
     return ss.str();
 }
 
-MatchVector cpp_remove_overlaps(MatchVector matches) {
-    if (matches.size() == 0) {
-        return matches;
-    }
+// The original quadratic dynamic programming, only used for spans that are empty
+// or reversed, where its results can not be reproduced by the faster version.
+static MatchVector remove_overlaps_quadratic(const MatchVector& matches) {
     #ifdef ACA_DEBUG
         std::cout << "matches before removing overlaps:\n";
         for (int i=0 ; i<matches.size() ; ++i) {
@@ -164,4 +163,136 @@ MatchVector cpp_remove_overlaps(MatchVector matches) {
     return result;
 }
 
+// Keeps the best score of the matches inserted so far among all the matches
+// ending at or before a position. Ends are compressed to indexes of ends.
+class BestBeforeTree {
+private:
+    // (score, -index): a higher score wins and then a smaller index
+    typedef std::pair<int, int> Entry;
+    std::vector<Entry> tree;
+public:
+    BestBeforeTree(const size_t size) : tree(size + 1, Entry(std::numeric_limits<int>::min(), 0)) { }
+
+    // set the entry of end index pos, entries can only grow
+    void insert(size_t pos, const int score, const int index) {
+        const Entry entry(score, -index);
+        for (++pos ; pos < tree.size() ; pos += pos & (~pos + 1)) {
+            tree[pos] = std::max(tree[pos], entry);
+        }
+    }
+    // get the index of the best match among the first count end indexes or -1
+    int best(size_t count, int& score) const {
+        Entry entry = tree[0];
+        for ( ; count > 0 ; count -= count & (~count + 1)) {
+            entry = std::max(entry, tree[count]);
+        }
+        score = entry.first;
+        return entry.first == std::numeric_limits<int>::min() ? -1 : -entry.second;
+    }
+};
+
+MatchVector cpp_remove_overlaps(MatchVector matches) {
+    if (matches.size() == 0) {
+        return matches;
+    }
+    for (const CppMatch& match : matches) {
+        if (match.get_end() <= match.get_start()) {
+            return remove_overlaps_quadratic(matches);
+        }
+    }
+    #ifdef ACA_DEBUG
+        std::cout << "matches before removing overlaps:\n";
+        for (int i=0 ; i<matches.size() ; ++i) {
+            std::cout << matches[i].str() << " ";
+        }
+    #endif
+    // The score of a match is its length plus the best score of the earlier matches
+    // in the vector that end before it starts, ties going to the earliest of them.
+    // The best score before a start is looked up from a Fenwick tree over the ends,
+    // so this takes O(n log n) and works for matches in any order.
+    IntVector ends;
+    ends.reserve(matches.size());
+    for (const CppMatch& match : matches) {
+        ends.push_back(match.get_end());
+    }
+    std::sort(ends.begin(), ends.end());
+    ends.erase(std::unique(ends.begin(), ends.end()), ends.end());
+
+    BestBeforeTree tree(ends.size());
+    IntVector scores(matches.size(), 0);
+    IntVector prev(matches.size(), -1);
+    int highscore = 0;
+    int highpos = -1;
+    for (size_t i=0 ; i<matches.size() ; ++i) {
+        const CppMatch& match = matches[i];
+        const size_t count = std::upper_bound(ends.begin(), ends.end(), match.get_start()) - ends.begin();
+        int bestscore;
+        prev[i] = tree.best(count, bestscore);
+        scores[i] = match.size() + (prev[i] != -1 ? bestscore : 0);
+        const size_t endpos = std::lower_bound(ends.begin(), ends.end(), match.get_end()) - ends.begin();
+        tree.insert(endpos, scores[i], static_cast<int>(i));
+        if (highpos == -1 || scores[i] >= highscore) {
+            highscore = scores[i];
+            highpos = i;
+        }
+    }
+    #ifdef ACA_DEBUG
+        std::cout << "scores:";
+        for (int i=0 ; i<scores.size() ; ++i) {
+            std::cout << " [" << i << "]=" << scores[i];
+        }
+        std::cout << '\n';
+        std::cout << "highscore: " << highscore << "\n";
+        std::cout << "highpos: " << highpos << "\n";
+    #endif
+    // back-track non-overlappng spans that we should keep
+    IntVector keep;
+    while (highpos != -1) {
+        keep.push_back(highpos);
+        highpos = prev[highpos];
+    }
+    MatchVector result;
+    result.reserve(keep.size());
+    for (auto iter=keep.rbegin() ; iter != keep.rend() ; ++iter) {
+        result.push_back(matches[*iter]);
+    }
+    return result;
+}
+
+void cpp_utf8_offsets(const char* text, const size_t size, MatchVector& matches) {
+    cpp_utf8_offsets(text, 0, size, 0, matches);
+}
+
+void cpp_utf8_offsets(const char* text, const size_t first, const size_t last, const int base,
+                      MatchVector& matches) {
+    if (matches.size() == 0) {
+        return;
+    }
+    // positions[i] is the number of code points that start before byte first + i,
+    // code points start at every byte that is not a continuation byte 10xxxxxx
+    IntVector positions(last - first + 1);
+    int count = base;
+    for (size_t i=first ; i<last ; ++i) {
+        positions[i - first] = count;
+        if ((static_cast<unsigned char>(text[i]) & 0xC0) != 0x80) {
+            ++count;
+        }
+    }
+    positions[last - first] = count;
+    for (CppMatch& match : matches) {
+        match.set_start(positions[match.get_start() - first]);
+        match.set_end(positions[match.get_end() - first]);
+    }
+}
+
+int cpp_utf8_length(const char* first, const char* last) {
+    int count = 0;
+    for ( ; first != last ; ++first) {
+        if ((static_cast<unsigned char>(*first) & 0xC0) != 0x80) {
+            ++count;
+        }
+    }
+    return count;
+}
+
 END_NAMESPACE
@@ -23,21 +23,21 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 BEGIN_NAMESPACE(aca)
 
+// A match refers to the value of its pattern by label id, see CppAutomaton::get_label
 class CppMatch {
 private:
     int start, end;
-    std::string label;
+    LabelId label;
 public:
-    CppMatch() : start(0), end(0), label("") { };
-    CppMatch(const int start, const int end, const std::string& label);
-    CppMatch(const int start, const int end, const char* label);
+    CppMatch() : start(0), end(0), label(NO_LABEL) { };
+    CppMatch(const int start, const int end, const LabelId label);
 
     void set_start(const int start);
     void set_end(const int end);
-    void set_label(const std::string& label);
+    void set_label(const LabelId label);
     int get_start() const { return start; }
     int get_end() const { return end; }
-    std::string get_label() const { return label; }
+    LabelId get_label() const { return label; }
 
     bool is_before(const CppMatch& m) const;
     CppMatch* operator=(const CppMatch& m);
@@ -48,8 +48,20 @@ public:
 };
 
 
+// matches are handed to Python as an array of three ints per match without copying
+static_assert(sizeof(CppMatch) == 3 * sizeof(int32_t), "CppMatch must consist of start, end and label");
+
+
 MatchVector cpp_remove_overlaps(MatchVector matches);
 
+// translate the byte positions of matches in a UTF-8 text to code point positions
+void cpp_utf8_offsets(const char* text, const size_t size, MatchVector& matches);
+// ... when the positions of the matches are in [first, last] and byte first is code point base
+void cpp_utf8_offsets(const char* text, const size_t first, const size_t last, const int base,
+                      MatchVector& matches);
+// the number of code points that start in [first, last) of a UTF-8 text
+int cpp_utf8_length(const char* first, const char* last);
+
 
 END_NAMESPACE
 
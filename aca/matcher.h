@@ -0,0 +1,101 @@
+/*
+Aho-Corasick keyword tree + automaton implementation for Python.
+Copyright (C) 2016 Funderbeam OÜ ( tpetmanson@gmail.com )
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+#ifndef AC__MATCHER_H
+#define AC__MATCHER_H
+
+#include "aca.h"
+
+BEGIN_NAMESPACE(aca)
+
+// State of a streaming matcher that is fed a text chunk by chunk, see
+// CppAutomaton::feed. It only remembers the automaton state reached so far
+// and the number of tokens consumed, so memory use does not depend on the
+// length of the text.
+class CppMatcherState {
+private:
+    NodeId node_id;
+    // the number of tokens scanned
+    long offset;
+    // the start of a code point cut off at the end of the last chunk, which is scanned with the
+    // next chunk when the automaton folds the case of multibyte code points
+    std::string pending;
+public:
+    CppMatcherState() : node_id(0), offset(0) { }
+
+    // the automaton state after the last token scanned
+    NodeId get_node_id() const { return node_id; }
+    // the number of tokens fed so far
+    long get_offset() const { return offset + static_cast<long>(pending.size()); }
+    // start matching a new text
+    void reset() { node_id = 0; offset = 0; pending.clear(); }
+
+    friend class CppAutomaton;
+};
+
+// Position of an iteration over the matches of a single text, see CppAutomaton::next_matches.
+// The text is given again on every call, the cursor remembers how much of it has been scanned.
+class CppMatchCursor {
+private:
+    NodeId node_id;
+    long offset;
+    // the number of code points before offset, for the UTF-8 offsets of byte mode
+    long code_points;
+public:
+    CppMatchCursor() : node_id(0), offset(0), code_points(0) { }
+
+    // the number of tokens, or bytes in byte mode, scanned so far
+    long get_offset() const { return offset; }
+    // start iterating over the matches of a new text
+    void reset() { node_id = 0; offset = 0; code_points = 0; }
+
+    friend class CppAutomaton;
+};
+
+// Position of a depth first iteration over the patterns, or the prefixes, under a node of the
+// keyword tree, see CppAutomaton::next_items. Only the path from the start node to the current
+// node is kept, so memory use depends on the depth of the trie and not on the number of patterns.
+class CppTrieCursor {
+private:
+    struct Frame {
+        NodeId node_id;
+        // the children of the node ordered by their tokens, and the next one to visit
+        std::vector<std::pair<SymbolId, NodeId>> children;
+        size_t next;
+    };
+    std::vector<Frame> path;
+    // the tokens of the pattern of the current node
+    StringVector key;
+    // the node on top of the path has not been reported yet
+    bool pending;
+    bool prefixes;
+    // the number of items still to skip and to return
+    size_t offset;
+    size_t limit;
+public:
+    CppTrieCursor() : pending(false), prefixes(false), offset(0), limit(0) { }
+
+    // no more items to return
+    bool done() const { return path.empty() || limit == 0; }
+
+    friend class CppAutomaton;
+};
+
+END_NAMESPACE
+
+#endif
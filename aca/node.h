@@ -24,26 +24,32 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 BEGIN_NAMESPACE(aca)
 
 
+// A node of the keyword tree. Nodes live in the arena of their automaton,
+// so they refer to each other by NodeId and the id of a node is its index.
+// A node with a value is terminal, i.e. it ends a pattern. The value is
+// the label id of the pattern's value in the label pool of the automaton.
 class CppNode {
 private:
-    int node_id, depth;
-    std::string value;
-    std::map<std::string, NodePtr> outs;
-    NodeVector matches;
+    int depth;
+    LabelId value;
+    // the order in which the pattern of a terminal node was added, see MATCH_LEFTMOST_FIRST
+    uint32_t rank;
+    std::map<SymbolId, NodeId> outs;
+    // the next terminal node on the fail chain of this node (dictionary suffix link)
+    NodeId output;
 public:
-    CppNode(const int node_id, const int depth);
-    CppNode(const int node_id, const int depth, const std::string& value);
+    CppNode(const int depth);
+    CppNode(const int depth, const LabelId value);
 
-    int get_id() const { return node_id; }
     int get_depth() const { return depth; }
-    void set_value(const std::string& value) { this->value = value; }
-    std::string get_value() const { return value; }
-    NodePtr get_outnode(const std::string& key) const;
-    void set_outnode(const std::string& key, const NodePtr value);
-    void add_match(const NodePtr node);
-
-    bool operator==(const CppNode& n) const;
-    std::string str() const;
+    void set_value(const LabelId value) { this->value = value; }
+    LabelId get_value() const { return value; }
+    uint32_t get_rank() const { return rank; }
+    bool is_terminal() const { return value != NO_LABEL; }
+    NodeId get_output() const { return output; }
+    const std::map<SymbolId, NodeId>& get_outs() const { return outs; }
+    NodeId get_outnode(const SymbolId key) const;
+    void set_outnode(const SymbolId key, const NodeId value);
 
     friend class CppAutomaton;
 };
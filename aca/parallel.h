@@ -0,0 +1,87 @@
+/*
+Aho-Corasick keyword tree + automaton implementation for Python.
+Copyright (C) 2016 Funderbeam OÜ ( tpetmanson@gmail.com )
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+#ifndef AC__PARALLEL_H
+#define AC__PARALLEL_H
+
+#include "aca.h"
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
+
+BEGIN_NAMESPACE(aca)
+
+// get the number of worker threads to use, 0 means one per core
+inline unsigned cpp_num_threads(const unsigned num_threads, const size_t num_items) {
+    unsigned result = num_threads > 0 ? num_threads : std::thread::hardware_concurrency();
+    if (result == 0) {
+        result = 1;
+    }
+    if (result > num_items) {
+        result = static_cast<unsigned>(num_items);
+    }
+    return result;
+}
+
+// call fn(i) for every i in [0, n) on num_threads threads. The items are handed
+// out one at a time, so that a few long items do not keep the other threads idle.
+// The first exception thrown by fn is rethrown after all the threads have finished.
+template <class Function>
+void cpp_parallel_for(const size_t n, const unsigned num_threads, Function fn) {
+    const unsigned nthreads = cpp_num_threads(num_threads, n);
+    if (nthreads <= 1) {
+        for (size_t i=0 ; i<n ; ++i) {
+            fn(i);
+        }
+        return;
+    }
+    std::atomic<size_t> next(0);
+    std::exception_ptr error;
+    std::mutex error_mutex;
+    auto worker = [&]() {
+        size_t i;
+        while ((i = next.fetch_add(1)) < n) {
+            try {
+                fn(i);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(error_mutex);
+                if (!error) {
+                    error = std::current_exception();
+                }
+                next = n; // stop handing out items
+            }
+        }
+    };
+    std::vector<std::thread> threads;
+    threads.reserve(nthreads - 1);
+    for (unsigned t=1 ; t<nthreads ; ++t) {
+        threads.push_back(std::thread(worker));
+    }
+    worker();
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+END_NAMESPACE
+
+#endif
@@ -0,0 +1,243 @@
+/*
+Aho-Corasick keyword tree + automaton implementation for Python.
+Copyright (C) 2016 Funderbeam OÜ ( tpetmanson@gmail.com )
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+#include "prefilter.h"
+#include <cstring>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    #define ACA_X86_KERNELS 1
+    #include <immintrin.h>
+#endif
+
+BEGIN_NAMESPACE(aca)
+
+// The set kernels look up the low nibble of each byte in the table of its top bit and test the bit
+// of its high nibble. A shuffle gives 0 for an index with the top bit set, so masking the byte with
+// 0x8f picks the low table for bytes below 128 and the high table for the others.
+static inline int count_trailing_zeros(const uint32_t mask) {
+    #ifdef __GNUC__
+        return __builtin_ctz(mask);
+    #else
+        int n = 0;
+        while (!(mask & (1u << n))) {
+            ++n;
+        }
+        return n;
+    #endif
+}
+
+static const char* find_scalar(const uint8_t* bytes, const char* first, const char* last) {
+    while (first != last && !bytes[static_cast<unsigned char>(*first)]) {
+        ++first;
+    }
+    return first;
+}
+
+#ifdef ACA_X86_KERNELS
+
+static const char* find_sse2(const uint8_t* needles, const size_t num_needles, const uint8_t* bytes,
+                             const char* first, const char* last) {
+    #ifdef __SSE2__
+        const __m128i n0 = _mm_set1_epi8(needles[0]);
+        const __m128i n1 = _mm_set1_epi8(needles[num_needles > 1 ? 1 : 0]);
+        const __m128i n2 = _mm_set1_epi8(needles[num_needles > 2 ? 2 : 0]);
+        for ( ; last - first >= 16 ; first += 16) {
+            const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(first));
+            const __m128i hits = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(block, n0), _mm_cmpeq_epi8(block, n1)),
+                                              _mm_cmpeq_epi8(block, n2));
+            const uint32_t mask = _mm_movemask_epi8(hits);
+            if (mask != 0) {
+                return first + count_trailing_zeros(mask);
+            }
+        }
+    #endif
+    return find_scalar(bytes, first, last);
+}
+
+__attribute__((target("ssse3")))
+static const char* find_ssse3(const uint8_t* table_low, const uint8_t* table_high, const uint8_t* bytes,
+                              const char* first, const char* last) {
+    const __m128i low = _mm_loadu_si128(reinterpret_cast<const __m128i*>(table_low));
+    const __m128i high = _mm_loadu_si128(reinterpret_cast<const __m128i*>(table_high));
+    const __m128i bits = _mm_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128);
+    const __m128i nibble = _mm_set1_epi8(0x0f);
+    const __m128i index_mask = _mm_set1_epi8(static_cast<char>(0x8f));
+    const __m128i top = _mm_set1_epi8(static_cast<char>(0x80));
+    const __m128i zero = _mm_setzero_si128();
+    for ( ; last - first >= 16 ; first += 16) {
+        const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(first));
+        const __m128i index = _mm_and_si128(block, index_mask);
+        const __m128i row = _mm_or_si128(_mm_shuffle_epi8(low, index),
+                                         _mm_shuffle_epi8(high, _mm_xor_si128(index, top)));
+        const __m128i bit = _mm_shuffle_epi8(bits, _mm_and_si128(_mm_srli_epi16(block, 4), nibble));
+        const uint32_t mask = ~_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(row, bit), zero)) & 0xffff;
+        if (mask != 0) {
+            return first + count_trailing_zeros(mask);
+        }
+    }
+    return find_scalar(bytes, first, last);
+}
+
+__attribute__((target("avx2")))
+static const char* find_avx2(const uint8_t* table_low, const uint8_t* table_high, const uint8_t* bytes,
+                             const char* first, const char* last) {
+    // shuffles work on the 128-bit lanes, so every table is repeated in both lanes
+    const __m256i low = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(table_low)));
+    const __m256i high = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(table_high)));
+    const __m256i bits = _mm256_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128,
+                                          1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128);
+    const __m256i nibble = _mm256_set1_epi8(0x0f);
+    const __m256i index_mask = _mm256_set1_epi8(static_cast<char>(0x8f));
+    const __m256i top = _mm256_set1_epi8(static_cast<char>(0x80));
+    const __m256i zero = _mm256_setzero_si256();
+    for ( ; last - first >= 32 ; first += 32) {
+        const __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(first));
+        const __m256i index = _mm256_and_si256(block, index_mask);
+        const __m256i row = _mm256_or_si256(_mm256_shuffle_epi8(low, index),
+                                            _mm256_shuffle_epi8(high, _mm256_xor_si256(index, top)));
+        const __m256i bit = _mm256_shuffle_epi8(bits, _mm256_and_si256(_mm256_srli_epi16(block, 4), nibble));
+        const uint32_t mask = ~static_cast<uint32_t>(
+            _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_and_si256(row, bit), zero)));
+        if (mask != 0) {
+            return first + count_trailing_zeros(mask);
+        }
+    }
+    return find_scalar(bytes, first, last);
+}
+
+#endif
+
+CppPrefilter::Kernel CppPrefilter::best_set_kernel() {
+    #ifdef ACA_X86_KERNELS
+        static const Kernel best = __builtin_cpu_supports("avx2") ? KERNEL_AVX2 :
+                                   __builtin_cpu_supports("ssse3") ? KERNEL_SSSE3 : KERNEL_SCALAR;
+        return best;
+    #else
+        return KERNEL_SCALAR;
+    #endif
+}
+
+CppPrefilter::CppPrefilter() {
+    // nothing is skipped until the candidates are known
+    reset(false, CASE_FOLD_NONE);
+    kernel = KERNEL_NONE;
+}
+
+void CppPrefilter::reset(const bool byte_mode, const CppCaseFold fold) {
+    this->byte_mode = byte_mode;
+    this->fold = fold;
+    symbols.clear();
+    std::memset(bytes, 0, sizeof(bytes));
+    std::memset(table_low, 0, sizeof(table_low));
+    std::memset(table_high, 0, sizeof(table_high));
+    num_bytes = 0;
+    if (byte_mode && fold == CASE_FOLD_UNICODE) {
+        // the bytes of a multibyte code point are folded together, so any of them may start a match
+        for (int b=0x80 ; b<256 ; ++b) {
+            set_byte(b);
+        }
+    }
+    choose_kernel();
+}
+
+void CppPrefilter::set_byte(const unsigned char byte) {
+    if (!bytes[byte]) {
+        bytes[byte] = 1;
+        ++num_bytes;
+        if (byte < 0x80) {
+            table_low[byte & 0x0f] |= 1 << (byte >> 4);
+        } else {
+            table_high[byte & 0x0f] |= 1 << ((byte >> 4) - 8);
+        }
+    }
+}
+
+void CppPrefilter::add_symbol(const SymbolId symbol) {
+    if (symbol >= symbols.size()) {
+        symbols.resize(symbol + 1, 0);
+    }
+    if (symbols[symbol]) {
+        return;
+    }
+    symbols[symbol] = 1;
+    if (byte_mode && symbol < 256) {
+        set_byte(symbol);
+        // the patterns are folded, so an upper case byte of the text can start a match as well
+        if (fold != CASE_FOLD_NONE && symbol >= 'a' && symbol <= 'z') {
+            set_byte(symbol - ('a' - 'A'));
+        }
+    }
+    choose_kernel();
+}
+
+void CppPrefilter::choose_kernel() {
+    if (!byte_mode) {
+        kernel = KERNEL_SCALAR;
+        return;
+    }
+    size_t n = 0;
+    for (int b=0 ; b<256 && n<=MAX_NEEDLES ; ++b) {
+        if (bytes[b]) {
+            if (n < MAX_NEEDLES) {
+                needles[n] = b;
+            }
+            ++n;
+        }
+    }
+    if (num_bytes == 256) {
+        kernel = KERNEL_NONE;
+    } else if (num_bytes == 1) {
+        kernel = KERNEL_MEMCHR;
+    } else if (num_bytes <= MAX_NEEDLES) {
+        #ifdef ACA_X86_KERNELS
+            kernel = KERNEL_SSE2;
+        #else
+            kernel = KERNEL_SCALAR;
+        #endif
+    } else {
+        kernel = best_set_kernel();
+    }
+}
+
+const char* CppPrefilter::find(const char* first, const char* last) const {
+    switch (kernel) {
+    case KERNEL_NONE:
+        return first;
+    case KERNEL_MEMCHR: {
+        const void* found = std::memchr(first, needles[0], last - first);
+        return found ? static_cast<const char*>(found) : last;
+    }
+    #ifdef ACA_X86_KERNELS
+        case KERNEL_SSE2:
+            return find_sse2(needles, num_bytes, bytes, first, last);
+        case KERNEL_SSSE3:
+            return find_ssse3(table_low, table_high, bytes, first, last);
+        case KERNEL_AVX2:
+            return find_avx2(table_low, table_high, bytes, first, last);
+    #endif
+    default:
+        return find_scalar(bytes, first, last);
+    }
+}
+
+std::string CppPrefilter::kernel_name() const {
+    static const char* NAMES[] = {"none", "scalar", "memchr", "sse2", "ssse3", "avx2"};
+    return NAMES[kernel];
+}
+
+END_NAMESPACE
@@ -0,0 +1,123 @@
+/*
+Aho-Corasick keyword tree + automaton implementation for Python.
+Copyright (C) 2016 Funderbeam OÜ ( tpetmanson@gmail.com )
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+#ifndef AC__PREFILTER_H
+#define AC__PREFILTER_H
+
+#include "aca.h"
+#include "casefold.h"
+#include <cstddef>
+
+BEGIN_NAMESPACE(aca)
+
+// Finds the positions of a text where a match can start, i.e. the symbols that leave the root of
+// the automaton. Everything before such a position keeps the automaton in the root without any
+// matches, so the matching loops skip it. Bytes are searched with SIMD kernels chosen by the CPU
+// the library runs on, the symbols of token mode are checked one by one.
+//
+// The candidates only grow until the prefilter is reset, so a pattern that has been removed may
+// still stop the search. That costs time but never a match.
+class CppPrefilter {
+public:
+    // how find searches the bytes of a text
+    enum Kernel {
+        // every byte is a candidate, there is nothing to skip
+        KERNEL_NONE = 0,
+        KERNEL_SCALAR = 1,
+        // a single candidate byte
+        KERNEL_MEMCHR = 2,
+        // up to MAX_NEEDLES candidate bytes compared 16 at a time
+        KERNEL_SSE2 = 3,
+        // any set of candidate bytes looked up in nibble tables 16 or 32 at a time
+        KERNEL_SSSE3 = 4,
+        KERNEL_AVX2 = 5
+    };
+    static const size_t MAX_NEEDLES = 3;
+private:
+    bool byte_mode;
+    CppCaseFold fold;
+    // symbol ids that leave the root are 1, indexed by symbol id
+    std::vector<uint8_t> symbols;
+    // bytes of a text that can start a match before they are case folded
+    uint8_t bytes[256];
+    size_t num_bytes;
+    Kernel kernel;
+    uint8_t needles[MAX_NEEDLES];
+    // bit h of table_low[l] is set if byte h * 16 + l is a candidate, table_high has the bytes from 128
+    uint8_t table_low[16];
+    uint8_t table_high[16];
+
+    void set_byte(const unsigned char byte);
+    void choose_kernel();
+public:
+    CppPrefilter();
+
+    // forget all the candidates, the bytes of a text are folded as given before they are matched
+    void reset(const bool byte_mode, const CppCaseFold fold);
+    // a symbol that leaves the root
+    void add_symbol(const SymbolId symbol);
+
+    bool is_candidate(const SymbolId symbol) const {
+        return symbol < symbols.size() && symbols[symbol] != 0;
+    }
+    // get the first byte in [first, last) that can start a match, or last
+    const char* find(const char* first, const char* last) const;
+    // get the first symbol in [first, last) that can start a match, or last
+    template <class Iter>
+    Iter find_symbol(Iter first, const Iter last) const {
+        while (first != last && !is_candidate(*first)) {
+            ++first;
+        }
+        return first;
+    }
+
+    Kernel get_kernel() const { return kernel; }
+    // the name of the kernel find uses, e.g. for the statistics
+    std::string kernel_name() const;
+    // the best kernel the CPU supports for sets of more than MAX_NEEDLES bytes
+    static Kernel best_set_kernel();
+    size_t bytes_used() const { return sizeof(*this) + symbols.capacity(); }
+};
+
+// Decides during a single scan if the prefilter is worth calling. A text where nearly every
+// position can start a match gains nothing from it, so it is switched off when the first
+// MIN_CALLS searches skip less than MIN_AVERAGE_SKIP symbols on average.
+class CppPrefilterState {
+private:
+    size_t calls;
+    size_t skipped;
+    bool active;
+public:
+    static const size_t MIN_CALLS = 32;
+    static const size_t MIN_AVERAGE_SKIP = 8;
+
+    CppPrefilterState(const CppPrefilter& prefilter)
+        : calls(0), skipped(0), active(prefilter.get_kernel() != CppPrefilter::KERNEL_NONE) { }
+
+    bool is_active() const { return active; }
+    void update(const size_t skip) {
+        skipped += skip;
+        if (++calls == MIN_CALLS && skipped < MIN_CALLS * MIN_AVERAGE_SKIP) {
+            active = false;
+        }
+    }
+};
+
+END_NAMESPACE
+
+#endif
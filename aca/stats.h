@@ -0,0 +1,158 @@
+/*
+Aho-Corasick keyword tree + automaton implementation for Python.
+Copyright (C) 2016 Funderbeam OÜ ( tpetmanson@gmail.com )
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+#ifndef AC__STATS_H
+#define AC__STATS_H
+
+#include "aca.h"
+#include <atomic>
+#include <chrono>
+#include <initializer_list>
+
+BEGIN_NAMESPACE(aca)
+
+// Hot path counters of an automaton. They are only collected when the library is compiled
+// with ACA_STATS defined (see aca.h), otherwise the scan counters and phase timers below are
+// empty and compile to nothing. The counters are shared by the matching threads, so they
+// are atomic and every scan adds its own counts to them once at the end.
+struct CppCounters {
+    std::atomic<uint64_t> transitions;
+    std::atomic<uint64_t> fail_links;
+    std::atomic<uint64_t> matches;
+    std::atomic<uint64_t> overlaps_removed;
+    // symbols passed over by the prefilter without a transition
+    std::atomic<uint64_t> skipped;
+    // automaton updates started by matching because the automaton had been modified
+    std::atomic<uint64_t> rebuilds;
+    // nanoseconds spent in each phase
+    std::atomic<uint64_t> update_ns;
+    std::atomic<uint64_t> compile_ns;
+    std::atomic<uint64_t> match_ns;
+    std::atomic<uint64_t> overlap_ns;
+
+    CppCounters() { reset(); }
+
+    void reset() {
+        for (std::atomic<uint64_t>* counter : {&transitions, &fail_links, &matches, &overlaps_removed, &skipped, &rebuilds,
+                                               &update_ns, &compile_ns, &match_ns, &overlap_ns}) {
+            counter->store(0, std::memory_order_relaxed);
+        }
+    }
+
+    std::map<std::string, uint64_t> to_map() const {
+        std::map<std::string, uint64_t> result;
+        #ifdef ACA_STATS
+            result["transitions"] = transitions.load(std::memory_order_relaxed);
+            result["fail_links"] = fail_links.load(std::memory_order_relaxed);
+            result["matches"] = matches.load(std::memory_order_relaxed);
+            result["overlaps_removed"] = overlaps_removed.load(std::memory_order_relaxed);
+            result["skipped"] = skipped.load(std::memory_order_relaxed);
+            result["rebuilds"] = rebuilds.load(std::memory_order_relaxed);
+            result["update_ns"] = update_ns.load(std::memory_order_relaxed);
+            result["compile_ns"] = compile_ns.load(std::memory_order_relaxed);
+            result["match_ns"] = match_ns.load(std::memory_order_relaxed);
+            result["overlap_ns"] = overlap_ns.load(std::memory_order_relaxed);
+        #endif
+        return result;
+    }
+};
+
+#ifdef ACA_STATS
+
+// add n to one of the counters
+#define ACA_COUNT(counter, n) (counter).fetch_add((n), std::memory_order_relaxed)
+
+// adds the time from its creation to its destruction to a counter
+class CppPhaseTimer {
+private:
+    std::atomic<uint64_t>& counter;
+    const std::chrono::steady_clock::time_point start;
+public:
+    CppPhaseTimer(std::atomic<uint64_t>& counter) : counter(counter), start(std::chrono::steady_clock::now()) { }
+    ~CppPhaseTimer() {
+        const auto elapsed = std::chrono::steady_clock::now() - start;
+        counter.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count(),
+                          std::memory_order_relaxed);
+    }
+};
+
+// counts the work of one scan of a text and adds it to the counters when the scan is done
+class CppScanCounter {
+private:
+    CppCounters& counters;
+    CppPhaseTimer timer;
+    uint64_t transitions, fail_links, matches, skipped;
+public:
+    CppScanCounter(CppCounters& counters)
+        : counters(counters), timer(counters.match_ns), transitions(0), fail_links(0), matches(0), skipped(0) { }
+    ~CppScanCounter() {
+        counters.transitions.fetch_add(transitions, std::memory_order_relaxed);
+        counters.fail_links.fetch_add(fail_links, std::memory_order_relaxed);
+        counters.matches.fetch_add(matches, std::memory_order_relaxed);
+        counters.skipped.fetch_add(skipped, std::memory_order_relaxed);
+    }
+    void transition() { ++transitions; }
+    void fail_link() { ++fail_links; }
+    void match() { ++matches; }
+    void skip(const uint64_t n) { skipped += n; }
+};
+
+#else
+
+#define ACA_COUNT(counter, n)
+
+class CppPhaseTimer {
+public:
+    CppPhaseTimer(std::atomic<uint64_t>&) { }
+};
+
+class CppScanCounter {
+public:
+    CppScanCounter(CppCounters&) { }
+    void transition() { }
+    void fail_link() { }
+    void match() { }
+    void skip(const uint64_t) { }
+};
+
+#endif
+
+// Structural statistics of an automaton, see CppAutomaton::get_stats
+struct CppStats {
+    // nodes reachable from the root, the root included
+    size_t num_nodes;
+    size_t num_patterns;
+    size_t max_depth;
+    // the number of matches reported in each node summed over the nodes,
+    // i.e. the total length of the output lists
+    size_t output_links;
+    // the number of nodes by their number of children
+    std::map<size_t, size_t> fanout;
+    // approximate bytes used by each component of the automaton
+    std::map<std::string, size_t> memory;
+    // the name of the kernel the prefilter searches the bytes of a text with, see CppPrefilter
+    std::string prefilter;
+    // the hot path counters, empty unless compiled with ACA_STATS
+    std::map<std::string, uint64_t> counters;
+
+    CppStats() : num_nodes(0), num_patterns(0), max_depth(0), output_links(0) { }
+};
+
+END_NAMESPACE
+
+#endif
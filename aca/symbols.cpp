@@ -0,0 +1,66 @@
+/*
+Aho-Corasick keyword tree + automaton implementation for Python.
+Copyright (C) 2016 Funderbeam OÜ ( tpetmanson@gmail.com )
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+#include "symbols.h"
+
+BEGIN_NAMESPACE(aca)
+
+SymbolId CppSymbolTable::intern(const std::string& symbol) {
+    auto iter = ids.find(symbol);
+    if (iter != ids.end()) {
+        return iter->second;
+    }
+    SymbolId id = static_cast<SymbolId>(symbols.size());
+    ids.emplace(symbol, id);
+    symbols.push_back(symbol);
+    return id;
+}
+
+SymbolId CppSymbolTable::find(const std::string& symbol) const {
+    auto iter = ids.find(symbol);
+    return iter != ids.end() ? iter->second : NO_SYMBOL;
+}
+
+SymbolVector CppSymbolTable::encode(const StringVector& tokens) const {
+    SymbolVector result;
+    result.reserve(tokens.size());
+    for (const std::string& token : tokens) {
+        result.push_back(find(token));
+    }
+    return result;
+}
+
+size_t CppSymbolTable::bytes() const {
+    // every symbol is stored twice, in the vector and as a key of a hash node
+    size_t total = symbols.capacity() * sizeof(std::string) + ids.bucket_count() * sizeof(void*) +
+                   ids.size() * (sizeof(std::pair<std::string, SymbolId>) + sizeof(void*) + sizeof(size_t));
+    for (const std::string& symbol : symbols) {
+        // short strings fit in the string object itself
+        if (symbol.capacity() >= sizeof(std::string)) {
+            total += 2 * (symbol.capacity() + 1);
+        }
+    }
+    return total;
+}
+
+void CppSymbolTable::clear() {
+    ids.clear();
+    symbols.clear();
+}
+
+END_NAMESPACE
@@ -0,0 +1,53 @@
+/*
+Aho-Corasick keyword tree + automaton implementation for Python.
+Copyright (C) 2016 Funderbeam OÜ ( tpetmanson@gmail.com )
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+#ifndef AC__SYMBOLS_H
+#define AC__SYMBOLS_H
+
+#include "aca.h"
+#include <unordered_map>
+
+BEGIN_NAMESPACE(aca)
+
+// Maps each distinct token to a dense integer id, so that the automaton
+// only has to compare integers when following transitions.
+class CppSymbolTable {
+private:
+    std::unordered_map<std::string, SymbolId> ids;
+    StringVector symbols;
+public:
+    // get the id of a symbol, adding it to the table if needed
+    SymbolId intern(const std::string& symbol);
+
+    // get the id of a symbol or NO_SYMBOL if it is not in the table
+    SymbolId find(const std::string& symbol) const;
+
+    // translate a token sequence to ids, unknown tokens become NO_SYMBOL
+    SymbolVector encode(const StringVector& tokens) const;
+
+    const std::string& get_symbol(const SymbolId id) const { return symbols[id]; }
+    const StringVector& get_symbols() const { return symbols; }
+    size_t size() const { return symbols.size(); }
+    // approximate bytes used by the table
+    size_t bytes() const;
+    void clear();
+};
+
+END_NAMESPACE
+
+#endif
@@ -0,0 +1,39 @@
+# -*- coding: utf-8 -*-
+from __future__ import unicode_literals, print_function, absolute_import
+
+import pytest
+from aca import Automaton
+
+PATTERNS = ['he', 'she', 'his', 'hers', 'öö', 'tööd']
+TEXTS = ['ushers', 'she said his hers', 'tööd ja öötööd', '', 'nothing'] * 50
+
+
+def check_batch(auto, texts):
+    expected = [auto.get_matches(text) for text in texts]
+    for num_threads in [0, 1, 4]:
+        results = auto.get_matches_batch(texts, num_threads=num_threads)
+        assert expected == results
+        assert [[m.elems for m in r] for r in expected] == [[m.elems for m in r] for r in results]
+    expected = [auto.get_matches(text, exclude_overlaps=False) for text in texts]
+    assert expected == auto.get_matches_batch(texts, exclude_overlaps=False, num_threads=3)
+
+
+def test_batch():
+    auto = Automaton()
+    auto.add_all(PATTERNS)
+    # the first batch updates the automaton
+    assert len(auto.get_matches_batch(TEXTS, num_threads=4)) == len(TEXTS)
+    check_batch(auto, TEXTS)
+    check_batch(auto, [text.split() for text in TEXTS])
+    auto.compile()
+    check_batch(auto, TEXTS)
+    assert [] == auto.get_matches_batch([])
+
+
+def test_batch_byte_mode():
+    auto = Automaton(byte_mode=True)
+    auto.add_all(PATTERNS)
+    check_batch(auto, TEXTS)
+    check_batch(auto, [text.encode('utf-8') for text in TEXTS])
+    with pytest.raises(TypeError):
+        auto.get_matches_batch(['tööd', b'hers'])
@@ -0,0 +1,50 @@
+# -*- coding: utf-8 -*-
+from __future__ import unicode_literals, print_function, absolute_import
+
+import random
+from aca import Automaton
+
+
+def random_patterns(rnd, n):
+    patterns = []
+    for _ in range(n):
+        word = ''.join(rnd.choice('abcd') for _ in range(rnd.randint(0, 6)))
+        if rnd.random() < 0.5:
+            patterns.append((word, rnd.choice(['x', 'y', ''])))
+        else:
+            patterns.append(word)
+    return patterns
+
+
+def check_same(expected, auto, rnd):
+    assert list(expected.prefixes()) == list(auto.prefixes())
+    for _ in range(5):
+        text = ''.join(rnd.choice('abcd') for _ in range(30))
+        assert expected.get_matches(text, exclude_overlaps=False) == auto.get_matches(text, exclude_overlaps=False)
+
+
+def test_same_as_add_all():
+    rnd = random.Random(5)
+    for num_threads in [1, 4]:
+        for _ in range(100):
+            patterns = random_patterns(rnd, rnd.randint(0, 30))
+            expected = Automaton()
+            expected.add_all(patterns)
+            auto = Automaton()
+            auto.build(patterns, num_threads=num_threads)
+            check_same(expected, auto, rnd)
+            # building into a non-empty automaton adds to it
+            more = random_patterns(rnd, 10)
+            expected.add_all(more)
+            auto.build(more, num_threads=num_threads)
+            check_same(expected, auto, rnd)
+
+
+def test_large_dictionary():
+    rnd = random.Random(9)
+    patterns = [''.join(rnd.choice('abcdefgh') for _ in range(rnd.randint(1, 8))) for _ in range(20000)]
+    expected = Automaton(byte_mode=True)
+    expected.add_all(patterns)
+    auto = Automaton(byte_mode=True)
+    auto.build(patterns, num_threads=4)
+    check_same(expected, auto, rnd)
@@ -0,0 +1,82 @@
+# -*- coding: utf-8 -*-
+from __future__ import unicode_literals, print_function, absolute_import
+
+import os
+import tempfile
+
+from aca import Automaton, Match
+
+PATTERNS = ['he', 'she', 'his', 'hers', 'öö', 'tööd']
+TEXTS = ['ushers', 'she said his hers', 'tööd ja öötööd', '']
+
+
+def make_automata():
+    chars = Automaton()
+    chars.add_all(PATTERNS)
+    nbytes = Automaton(byte_mode=True)
+    nbytes.add_all(PATTERNS)
+    return chars, nbytes
+
+
+def test_same_as_character_mode():
+    chars, nbytes = make_automata()
+    assert nbytes.is_byte_mode()
+    assert not chars.is_byte_mode()
+    for text in TEXTS:
+        for exclude_overlaps in [True, False]:
+            expected = chars.get_matches(text, exclude_overlaps)
+            matches = nbytes.get_matches(text, exclude_overlaps)
+            assert expected == matches
+            assert [m.elems for m in expected] == [m.elems for m in matches]
+    nbytes.compile()
+    assert chars.get_matches(TEXTS[2]) == nbytes.get_matches(TEXTS[2])
+
+
+def test_byte_offsets():
+    chars, nbytes = make_automata()
+    text = 'tööd'.encode('utf-8')
+    assert [Match(0, 6, 'Y')] == nbytes.get_matches(text)
+    assert [Match(1, 5, 'Y'), Match(0, 6, 'Y')] == nbytes.get_matches(text, exclude_overlaps=False)[::-1]
+    assert b'\xc3\xb6\xc3\xb6' == nbytes.get_matches(text, exclude_overlaps=False)[1].elems
+
+
+def test_dictionary_interface():
+    chars, nbytes = make_automata()
+    nbytes['öö'] = 'eyes'
+    assert 'eyes' == nbytes['öö']
+    assert nbytes.has_pattern('tööd')
+    assert nbytes.has_prefix('tö')
+    assert not nbytes.has_pattern('tö')
+    assert sorted(''.join(k) for k, v in chars.items()) == sorted(k for k, v in nbytes.items()) == sorted(PATTERNS)
+    prefixes = [k for k, v in nbytes.prefixes()]
+    assert 'tö' in prefixes
+
+
+def test_stream():
+    chars, nbytes = make_automata()
+    matcher = nbytes.matcher()
+    data = 'xtööd'.encode('utf-8')
+    assert [] == matcher.feed(data[:3])
+    assert [Match(2, 6, 'Y'), Match(1, 7, 'Y')] == matcher.feed(data[3:])
+
+
+def test_serialize():
+    chars, nbytes = make_automata()
+    nbytes.compile()
+    copy = Automaton()
+    copy.load_from_string(nbytes.save_to_string())
+    assert copy.is_byte_mode()
+    assert nbytes.get_matches(TEXTS[2]) == copy.get_matches(TEXTS[2])
+    # plain automata are still written in the old format
+    assert chars.save_to_string().split(b'\n')[0].count(b' ') == 2
+
+    fd, fnm = tempfile.mkstemp()
+    os.close(fd)
+    try:
+        nbytes.save_mmap(fnm)
+        mapped = Automaton()
+        mapped.load_mmap(fnm)
+        assert mapped.is_byte_mode()
+        assert nbytes.get_matches(TEXTS[1]) == mapped.get_matches(TEXTS[1])
+    finally:
+        os.remove(fnm)
@@ -0,0 +1,126 @@
+# -*- coding: utf-8 -*-
+from __future__ import unicode_literals, print_function, absolute_import
+import pytest
+from aca import Automaton
+
+
+def spans(matches):
+    return [(match.start, match.end, match.label) for match in matches]
+
+
+@pytest.mark.parametrize('byte_mode', [False, True])
+def test_ascii_fold(byte_mode):
+    automaton = Automaton(byte_mode=byte_mode, case_fold='ascii')
+    automaton.add('Hello', 'greeting')
+    automaton.add('WORLD', 'place')
+    matches = automaton.get_matches('say hElLo to the World')
+    assert spans(matches) == [(4, 9, 'greeting'), (17, 22, 'place')]
+    # the elems are taken from the original text
+    assert [match.elems for match in matches] == ['hElLo', 'World']
+    assert automaton.has_pattern('HELLO')
+    assert automaton['world'] == 'place'
+    # non-ASCII letters are not folded
+    automaton.add('Äpfel')
+    assert automaton.get_matches('äpfel') == []
+    assert len(automaton.get_matches('ÄPFEL')) == 1
+
+
+@pytest.mark.parametrize('byte_mode', [False, True])
+def test_unicode_fold(byte_mode):
+    automaton = Automaton(byte_mode=byte_mode, case_fold='unicode')
+    automaton.add('Äpfel')
+    automaton.add('ΣΟΦΙΑ')
+    automaton.add('москва')
+    text = 'ÄPFEL und äpfel, σοφια in МОСКВА'
+    assert [match.elems for match in automaton.get_matches(text)] == ['ÄPFEL', 'äpfel', 'σοφια', 'МОСКВА']
+    assert automaton.has_pattern('äPFEL')
+
+
+def test_byte_offsets():
+    automaton = Automaton(byte_mode=True, case_fold='unicode')
+    automaton.add('straße')
+    text = 'STRASSE oder STRAßE'.encode('utf-8')
+    matches = automaton.get_matches(text)
+    assert [(match.start, match.end) for match in matches] == [(13, 20)]
+    assert matches[0].elems == 'STRAßE'.encode('utf-8')
+
+
+def test_token_mode():
+    automaton = Automaton(case_fold='unicode')
+    automaton.add(['Tom', 'Anderson'], 'manager')
+    text = ['TOM', 'ANDERSON', 'met', 'tom', 'anderson']
+    matches = automaton.get_matches(text)
+    assert spans(matches) == [(0, 2, 'manager'), (3, 5, 'manager')]
+    assert [match.elems for match in matches] == [['TOM', 'ANDERSON'], ['tom', 'anderson']]
+
+
+@pytest.mark.parametrize('byte_mode', [False, True])
+def test_other_modes(byte_mode):
+    automaton = Automaton(byte_mode=byte_mode, case_fold='ascii')
+    automaton.build([('abc', 'x'), ('BCD', 'y')])
+    text = 'xABCDx'
+    assert spans(automaton.get_matches(text, exclude_overlaps=False)) == [(1, 4, 'x'), (2, 5, 'y')]
+    assert spans(automaton.get_matches(text, match_kind='leftmost_longest')) == [(1, 4, 'x')]
+    assert automaton.contains_any('ABC')
+    assert automaton.count_matches(text) == 2
+    matcher = automaton.matcher()
+    assert spans(matcher.feed('xAB')) == []
+    assert spans(matcher.feed('Cd')) == [(1, 4, 'x'), (2, 5, 'y')]
+    automaton.compile()
+    assert spans(automaton.get_matches(text, exclude_overlaps=False)) == [(1, 4, 'x'), (2, 5, 'y')]
+    assert automaton.remove('ABC')
+    assert spans(automaton.get_matches(text)) == [(2, 5, 'y')]
+
+
+def test_saved_fold(tmpdir):
+    automaton = Automaton(case_fold='ascii', nfc=False)
+    automaton.add('Hello')
+    copy = Automaton()
+    copy.load_from_string(automaton.save_to_string())
+    assert copy.case_fold() == 'ascii'
+    assert len(copy.get_matches('HELLO')) == 1
+    assert copy.encode_tokens(['e\u0301']) == ['e\u0301'.encode('utf-8')]
+
+    fnm = str(tmpdir.join('fold.aca'))
+    automaton.save_mmap(fnm)
+    mapped = Automaton()
+    mapped.load_mmap(fnm)
+    assert mapped.case_fold() == 'ascii'
+    assert len(mapped.get_matches('hELLO')) == 1
+
+
+def test_nfc():
+    decomposed = ['e\u0301']
+    automaton = Automaton()
+    automaton.add(decomposed)
+    assert automaton.has_pattern(['\u00e9'])
+    automaton = Automaton(nfc=False)
+    automaton.add(decomposed)
+    assert not automaton.has_pattern(['\u00e9'])
+    assert automaton.has_pattern(decomposed)
+
+
+def test_unknown_case_fold():
+    with pytest.raises(ValueError):
+        Automaton(case_fold='upper')
+
+
+def test_stream_split_character():
+    automaton = Automaton(byte_mode=True, case_fold='unicode')
+    automaton.add('bä')
+    automaton.add('Ω')
+    data = 'xBÄ ΩΩ'.encode('utf-8')
+    expected = [(m.start, m.end) for m in automaton.get_matches(data, exclude_overlaps=False)]
+    assert expected == [(1, 4), (5, 7), (7, 9)]
+    # every way of cutting the text into chunks, including inside the folded characters
+    for size in range(1, len(data) + 1):
+        matcher = automaton.matcher()
+        found = []
+        for i in range(0, len(data), size):
+            found.extend((m.start, m.end) for m in matcher.feed(data[i:i + size]))
+        assert found == expected
+        assert matcher.offset == len(data)
+    matcher = automaton.matcher()
+    d = 'BÄ'.encode('utf-8')
+    assert matcher.feed(d[:2]) == []
+    assert [(m.start, m.end) for m in matcher.feed(d[2:])] == [(0, 3)]
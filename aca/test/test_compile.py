@@ -0,0 +1,53 @@
+# -*- coding: utf-8 -*-
+from __future__ import unicode_literals, print_function, absolute_import
+
+import random
+import string
+from aca import Automaton
+
+
+def random_words(rnd, alphabet, count, max_length):
+    return [''.join(rnd.choice(alphabet) for _ in range(rnd.randint(1, max_length))) for _ in range(count)]
+
+
+def assert_same_matches(auto, texts):
+    expected = [auto.get_matches(text, exclude_overlaps=False) for text in texts]
+    auto.compile()
+    assert auto.is_compiled()
+    actual = [auto.get_matches(text, exclude_overlaps=False) for text in texts]
+    assert expected == actual
+
+
+def test_compiled_matches():
+    auto = Automaton()
+    for token in ['he', 'she', 'his', 'hers']:
+        auto.add(token)
+    auto.compile()
+    assert [(1, 4), (2, 4), (2, 6)] == [(m.start, m.end) for m in auto.get_matches('ushers', exclude_overlaps=False)]
+    assert [(2, 6)] == [(m.start, m.end) for m in auto.get_matches('ushers')]
+
+
+def test_compiled_small_alphabet():
+    rnd = random.Random(0)
+    auto = Automaton()
+    auto.add_all(random_words(rnd, 'abc', 200, 6))
+    assert_same_matches(auto, random_words(rnd, 'abcd', 50, 60))
+
+
+def test_compiled_high_fanout():
+    # states with a transition for every letter get dense rows
+    rnd = random.Random(1)
+    auto = Automaton()
+    auto.add_all(a + b for a in string.ascii_lowercase for b in string.ascii_lowercase)
+    auto.add_all(random_words(rnd, string.ascii_lowercase, 500, 8))
+    assert_same_matches(auto, random_words(rnd, string.ascii_lowercase + ' ', 50, 200))
+
+
+def test_add_after_compile():
+    auto = Automaton()
+    auto.add('hers')
+    auto.compile()
+    assert len(auto.get_matches('ushers')) == 1
+    auto.add('us')
+    assert not auto.is_compiled()
+    assert len(auto.get_matches('ushers')) == 2
@@ -0,0 +1,35 @@
+# -*- coding: utf-8 -*-
+from __future__ import unicode_literals, print_function, absolute_import
+
+from collections import Counter
+from aca import Automaton
+
+PATTERNS = [('he', 'pronoun'), ('she', 'pronoun'), ('his', 'pronoun'), ('hers', 'pronoun'), ('us', 'us')]
+TEXTS = ['ushers', 'she said his hers', 'nothing', '']
+
+
+def check_counts(auto):
+    for text in TEXTS:
+        for exclude_overlaps in [False, True]:
+            matches = auto.get_matches(text, exclude_overlaps=exclude_overlaps)
+            assert len(matches) == auto.count_matches(text, exclude_overlaps=exclude_overlaps)
+            assert Counter(m.label for m in matches) == auto.count_by_label(text, exclude_overlaps=exclude_overlaps)
+        assert auto.contains_any(text) == (len(auto.get_matches(text)) > 0)
+
+
+def test_counts():
+    for byte_mode in [False, True]:
+        auto = Automaton(byte_mode=byte_mode)
+        auto.add_all(PATTERNS)
+        check_counts(auto)
+        auto.compile()
+        check_counts(auto)
+        assert {'pronoun': 3, 'us': 1} == auto.count_by_label('ushers')
+
+
+def test_tokens():
+    auto = Automaton()
+    auto.add(['tom', 'anderson'], 'person')
+    assert auto.contains_any('my friend tom anderson'.split())
+    assert not auto.contains_any('my friend tom'.split())
+    assert 2 == auto.count_matches('tom anderson and tom anderson'.split(), exclude_overlaps=True)
@@ -0,0 +1,101 @@
+# -*- coding: utf-8 -*-
+from __future__ import unicode_literals, print_function, absolute_import
+import random
+import pytest
+from aca import Automaton
+
+
+def random_words(rng, count):
+    return [''.join(rng.choice('abcdeäö') for _ in range(rng.randint(1, 8))) for _ in range(count)]
+
+
+def make_automaton(items, **kwargs):
+    automaton = Automaton(**kwargs)
+    for key, value in items:
+        automaton[key] = value
+    return automaton
+
+
+@pytest.mark.parametrize('byte_mode', [False, True])
+def test_apply(byte_mode):
+    rng = random.Random(21)
+    words = sorted(set(random_words(rng, 3000)))
+    old = dict((word, 'v' + word) for word in words)
+    new = dict(old)
+    for word in rng.sample(words, 50):
+        del new[word]
+    for word in rng.sample(words, 50):
+        new[word] = 'changed'
+    for word in random_words(rng, 50):
+        new[word] = 'added'
+    base = make_automaton(sorted(old.items()), byte_mode=byte_mode)
+    target = make_automaton(rng.sample(sorted(new.items()), len(new)), byte_mode=byte_mode)
+    delta = target.save_delta_to_string(base)
+    assert len(delta) < len(target.save_to_string()) // 10
+
+    worker = Automaton()
+    worker.load_from_string(base.save_to_string())
+    text = ' '.join(rng.sample(words, 500))
+    worker.get_matches(text)
+    assert worker.apply_delta_from_string(delta) > 0
+    assert worker.content_hash() == target.content_hash()
+    assert list(worker.items()) == list(target.items())
+    assert worker.get_matches(text, exclude_overlaps=False) == target.get_matches(text, exclude_overlaps=False)
+
+
+def test_hash():
+    a = make_automaton([('ab', 'x'), ('cd', 'y')])
+    b = make_automaton([('cd', 'y'), ('ab', 'x')])
+    assert a.content_hash() == b.content_hash()
+    b['ab'] = 'z'
+    assert a.content_hash() != b.content_hash()
+    b['ab'] = 'x'
+    assert a.content_hash() == b.content_hash()
+    assert make_automaton([('ab', 'x')], byte_mode=True).content_hash() != make_automaton([('ab', 'x')]).content_hash()
+
+
+def test_wrong_version():
+    base = make_automaton([('ab', 'x')])
+    target = make_automaton([('ab', 'x'), ('cd', 'y')])
+    delta = target.save_delta_to_string(base)
+    other = make_automaton([('ab', 'y')])
+    with pytest.raises(RuntimeError):
+        other.apply_delta_from_string(delta)
+    assert list(other.items()) == [(['a', 'b'], 'y')]
+    # applying a delta twice
+    base.apply_delta_from_string(delta)
+    with pytest.raises(RuntimeError):
+        base.apply_delta_from_string(delta)
+    with pytest.raises(RuntimeError):
+        base.apply_delta_from_string(b'not a delta')
+
+
+def test_file_and_tokens(tmpdir):
+    base = Automaton(case_fold='unicode')
+    base.add(['New', 'York'], 'city')
+    base.add(['Paris'], 'city')
+    target = Automaton(case_fold='unicode')
+    target.add(['new', 'york'], 'big city')
+    target.add(['new', 'york', 'times'], 'paper')
+    fnm = str(tmpdir.join('update.delta'))
+    target.save_delta_to_file(base, fnm)
+    assert base.apply_delta_from_file(fnm) == 3
+    assert base['NEW', 'YORK'] == 'big city'
+    assert 'Paris' not in base
+    assert [match.label for match in base.get_matches(['in', 'New', 'York', 'Times'], exclude_overlaps=False)] == ['big city', 'paper']
+
+
+def test_mapped(tmpdir):
+    base = make_automaton([('ab', 'x')])
+    fnm = str(tmpdir.join('base.aca'))
+    base.save_mmap(fnm)
+    mapped = Automaton()
+    mapped.load_mmap(fnm)
+    assert mapped.content_hash() == base.content_hash()
+    target = make_automaton([('ab', 'x'), ('b', 'y')])
+    delta = target.save_delta_to_string(mapped)
+    # a mapped automaton is read-only
+    with pytest.raises(RuntimeError):
+        mapped.apply_delta_from_string(delta)
+    base.apply_delta_from_string(delta)
+    assert base.content_hash() == target.content_hash()
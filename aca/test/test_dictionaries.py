@@ -0,0 +1,165 @@
+# -*- coding: utf-8 -*-
+from __future__ import unicode_literals, print_function, absolute_import
+import random
+import pytest
+from aca import Automaton
+
+
+def spans(matches):
+    return [(match.start, match.end, match.label, match.dictionary) for match in matches]
+
+
+def make_tenants(rng, count, **kwargs):
+    """ A multi-dictionary automaton and a separate automaton for each dictionary. """
+    vocabulary = [''.join(rng.choice('abcd') for _ in range(rng.randint(1, 4))) for _ in range(200)]
+    multi = Automaton(multi_dictionary=True, **kwargs)
+    single = []
+    for dict_id in range(count):
+        automaton = Automaton(**kwargs)
+        for word in rng.sample(vocabulary, 40):
+            value = '{}-{}'.format(word, dict_id % 3)
+            multi.add(word, value, dictionary=dict_id)
+            automaton.add(word, value)
+        single.append(automaton)
+    return multi, single
+
+
+def separately(single, text, dict_ids, exclude_overlaps):
+    expected = []
+    for dict_id in dict_ids:
+        for match in single[dict_id].get_matches(text, exclude_overlaps=exclude_overlaps):
+            expected.append((match.start, match.end, match.label, dict_id))
+    return sorted(expected, key=lambda span: (span[0], span[1], span[3]))
+
+
+@pytest.mark.parametrize('byte_mode', [False, True])
+def test_same_as_separate(byte_mode):
+    rng = random.Random(31)
+    multi, single = make_tenants(rng, 10, byte_mode=byte_mode)
+    text = ''.join(rng.choice('abcd ') for _ in range(2000))
+    for dict_ids in ([3], [0, 5, 9], range(10)):
+        for exclude_overlaps in (False, True):
+            matches = multi.get_matches(text, exclude_overlaps=exclude_overlaps, dictionaries=dict_ids)
+            assert spans(matches) == separately(single, text, dict_ids, exclude_overlaps)
+            assert all(match.elems == text[match.start:match.end] for match in matches)
+    # a bitmask and all the dictionaries
+    assert spans(multi.get_matches(text, dictionaries=0b1001)) == separately(single, text, [0, 3], True)
+    assert spans(multi.get_matches(text)) == separately(single, text, range(10), True)
+    multi.compile()
+    assert spans(multi.get_matches(text, dictionaries=[2, 4])) == separately(single, text, [2, 4], True)
+
+
+def test_values():
+    automaton = Automaton(multi_dictionary=True)
+    automaton.add('apple', 'fruit', dictionary=0)
+    automaton.add('apple', 'company', dictionary=7)
+    automaton.add('pear', 'fruit', dictionary=0)
+    assert automaton.num_dictionaries() == 8
+    assert automaton['apple'] == {0: 'fruit', 7: 'company'}
+    assert list(automaton.items()) == [(list('apple'), {0: 'fruit', 7: 'company'}), (list('pear'), {0: 'fruit'})]
+    automaton.add('apple', 'computer', dictionary=7)
+    assert spans(automaton.get_matches('an apple', dictionaries=[7])) == [(3, 8, 'computer', 7)]
+    assert automaton.get_matches('a pear', dictionaries=[7]) == []
+    assert automaton.get_matches('a pear', dictionaries=[]) == []
+
+
+def test_remove():
+    automaton = Automaton(multi_dictionary=True)
+    automaton.add('apple', 'fruit', dictionary=0)
+    automaton.add('apple', 'company', dictionary=1)
+    assert automaton.get_matches('apple', dictionaries=[0])
+    assert automaton.remove('apple', dictionary=0)
+    assert not automaton.remove('apple', dictionary=0)
+    assert automaton['apple'] == {1: 'company'}
+    assert automaton.get_matches('apple', dictionaries=[0]) == []
+    assert automaton.remove('apple', dictionary=1)
+    assert 'apple' not in automaton
+
+
+def test_bounded_growth():
+    automaton = Automaton(multi_dictionary=True)
+    words = ['apple', 'pear', 'plum']
+    for dict_id in range(300):
+        for word in words:
+            automaton.add(word, 'fruit {}'.format(dict_id % 2), dictionary=dict_id)
+    # one label per pattern, whose set of dictionaries changes in place
+    assert len(automaton.labels()) == len(words) + 1
+    memory = automaton.stats()['memory']
+    assert memory['labels'] < 1000
+    assert memory['dictionaries'] < 32 * 300 * len(words)
+    for dict_id in range(300):
+        automaton.add('apple', 'fruit {}'.format(dict_id % 2), dictionary=dict_id)
+        assert automaton.remove('plum', dictionary=dict_id)
+    assert automaton.stats()['memory']['dictionaries'] <= memory['dictionaries']
+    automaton.compact()
+    assert len(automaton.labels()) == len(words)
+    assert automaton['pear'] == {i: 'fruit {}'.format(i % 2) for i in range(300)}
+    assert 'plum' not in automaton
+    assert len(automaton.get_matches('apple pear plum', dictionaries=[0, 299])) == 4
+
+
+def overlapping_tenants():
+    automaton = Automaton(multi_dictionary=True)
+    automaton.add('ab', 'X', dictionary=0)
+    automaton.add('b', 'Z', dictionary=1)
+    return automaton
+
+
+def test_batch():
+    automaton = overlapping_tenants()
+    expected = [(1, 3, 'X', 0), (2, 3, 'Z', 1)]
+    assert [spans(matches) for matches in automaton.get_matches_batch(['xab', 'b'])] == [expected, [(0, 1, 'Z', 1)]]
+    assert [spans(matches) for matches in automaton.get_matches_batch(['xab'], dictionaries=[1])] == [[(2, 3, 'Z', 1)]]
+    with pytest.raises(ValueError):
+        automaton.get_matches_batch(['xab'], match_kind='leftmost_first')
+
+
+def test_count_matches():
+    automaton = overlapping_tenants()
+    assert automaton.count_matches('xab', exclude_overlaps=True) == 2
+    assert automaton.count_matches('xab', exclude_overlaps=False) == 2
+    assert automaton.count_matches('xab', dictionaries=[0]) == 1
+
+
+def test_labels():
+    automaton = overlapping_tenants()
+    automaton.add('ab', 'Y', dictionary=2)
+    assert automaton.labels() == ['', {0: 'X', 2: 'Y'}, {1: 'Z'}]
+    with pytest.raises(ValueError):
+        automaton.count_by_label('xab')
+
+
+def test_match_array():
+    with pytest.raises(ValueError):
+        overlapping_tenants().get_matches_array('xab')
+
+
+def test_saved(tmpdir):
+    automaton = Automaton(multi_dictionary=True, byte_mode=True)
+    automaton.add('ab', 'x', dictionary=0)
+    automaton.add('ab', 'y', dictionary=2)
+    automaton.add('b', 'z', dictionary=2)
+    expected = spans(automaton.get_matches('cab', exclude_overlaps=False))
+    assert expected == [(1, 3, 'x', 0), (1, 3, 'y', 2), (2, 3, 'z', 2)]
+    copy = Automaton()
+    copy.load_from_string(automaton.save_to_string())
+    assert copy.is_multi_dictionary()
+    assert spans(copy.get_matches('cab', exclude_overlaps=False)) == expected
+    fnm = str(tmpdir.join('dicts.aca'))
+    automaton.save_mmap(fnm)
+    mapped = Automaton()
+    mapped.load_mmap(fnm)
+    assert spans(mapped.get_matches('cab', exclude_overlaps=False)) == expected
+    assert mapped['ab'] == {0: 'x', 2: 'y'}
+
+
+def test_errors():
+    automaton = Automaton(multi_dictionary=True)
+    with pytest.raises(ValueError):
+        automaton.add('apple', 'fruit')
+    with pytest.raises(ValueError):
+        automaton.get_matches('apple', match_kind='leftmost_longest')
+    with pytest.raises(ValueError):
+        Automaton().add('apple', 'fruit', dictionary=0)
+    with pytest.raises(ValueError):
+        Automaton().get_matches('apple', dictionaries=[0])
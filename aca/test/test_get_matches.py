@@ -51,4 +51,19 @@ def test_lemmas():
     assert len(matches) == 2
 
 
+def test_suffix_of_unfinished_pattern():
+    # 'e' ends inside the unfinished pattern 'hers'
+    auto = Automaton()
+    auto.add('hers')
+    auto.add('e')
+    assert [Match(1, 2, 'Y')] == auto.get_matches('her', exclude_overlaps=False)
+
+
+def test_nested_patterns():
+    auto = Automaton()
+    auto.add_all(['a', 'aa', 'aaa'])
+    matches = auto.get_matches('aaa', exclude_overlaps=False)
+    assert [(0, 1), (0, 2), (0, 3), (1, 2), (1, 3), (2, 3)] == [(m.start, m.end) for m in matches]
+
+
 test_lemmas()
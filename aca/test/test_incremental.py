@@ -0,0 +1,55 @@
+# -*- coding: utf-8 -*-
+from __future__ import unicode_literals, print_function, absolute_import
+
+import random
+from aca import Automaton
+
+
+def random_word(rnd):
+    return ''.join(rnd.choice('abc') for _ in range(rnd.randint(1, 5)))
+
+
+def test_same_as_full_update():
+    rnd = random.Random(7)
+    for _ in range(200):
+        incremental = Automaton()
+        full = Automaton()
+        incremental.update_automaton()
+        for _ in range(rnd.randint(1, 15)):
+            word = random_word(rnd)
+            # an empty value removes the pattern
+            value = rnd.choice(['x', 'y', ''])
+            incremental[word] = value
+            full[word] = value
+            # the links have to be right after every addition
+            text = ''.join(rnd.choice('abc') for _ in range(20))
+            expected = Automaton()
+            for pattern, value in incremental.items():
+                expected[pattern] = value
+            assert expected.get_matches(text, exclude_overlaps=False) == \
+                incremental.get_matches(text, exclude_overlaps=False)
+        full.update_automaton()
+        # same insertion order gives the same node ids, fail table and matches
+        assert full.save_to_string() == incremental.save_to_string()
+
+
+def test_matches_after_adding():
+    auto = Automaton()
+    auto.add_all(['his', 'hers'])
+    assert [m.elems for m in auto.get_matches('ushers', exclude_overlaps=False)] == ['hers']
+    auto.add('she')
+    auto.add('he')
+    assert [m.elems for m in auto.get_matches('ushers', exclude_overlaps=False)] == ['she', 'he', 'hers']
+    del auto['he']
+    assert [m.elems for m in auto.get_matches('ushers', exclude_overlaps=False)] == ['she', 'hers']
+
+
+def test_deserialized_automaton():
+    auto = Automaton()
+    auto.add_all(['abc', 'bc'])
+    copy = Automaton()
+    copy.load_from_string(auto.save_to_string())
+    copy.add('c')
+    auto.add('c')
+    assert auto.get_matches('abc', exclude_overlaps=False) == copy.get_matches('abc', exclude_overlaps=False)
+    assert auto.save_to_string() == copy.save_to_string()
@@ -0,0 +1,99 @@
+# -*- coding: utf-8 -*-
+from __future__ import unicode_literals, print_function, absolute_import
+import itertools
+import random
+import pytest
+from aca import Automaton
+
+
+def spans(matches):
+    return [(match.start, match.end, match.label) for match in matches]
+
+
+def by_end(matches):
+    return sorted(spans(matches), key=lambda span: (span[1], span[0]))
+
+
+def make_automaton(patterns, **kwargs):
+    automaton = Automaton(**kwargs)
+    for pattern in patterns:
+        automaton.add(pattern, pattern)
+    return automaton
+
+
+def long_text(rng, alphabet, size):
+    # longer than a batch, so that the iteration has to resume the scan
+    return ''.join(rng.choice(alphabet) for _ in range(size))
+
+
+@pytest.mark.parametrize('byte_mode', [False, True])
+def test_same_as_get_matches(byte_mode):
+    rng = random.Random(3)
+    patterns = ['ab', 'abc', 'bca', 'cab', 'a', 'öä', 'äö€']
+    automaton = make_automaton(patterns, byte_mode=byte_mode)
+    text = long_text(rng, 'abcöä€ ', 10000)
+    matches = list(automaton.iter_matches(text))
+    assert spans(matches) == by_end(automaton.get_matches(text, exclude_overlaps=False))
+    assert all(match.elems == text[match.start:match.end] for match in matches)
+    for kind in ('leftmost_longest', 'leftmost_first'):
+        assert spans(automaton.iter_matches(text, match_kind=kind)) == spans(automaton.get_matches(text, match_kind=kind))
+    if byte_mode:
+        data = text.encode('utf-8')
+        assert spans(automaton.iter_matches(data)) == by_end(automaton.get_matches(data, exclude_overlaps=False))
+
+
+def test_tokens():
+    automaton = Automaton()
+    automaton.add_all([['new', 'york'], ['york']])
+    text = ['in', 'new', 'york', 'and', 'new', 'york']
+    matches = list(automaton.iter_matches(text))
+    assert [(match.start, match.end) for match in matches] == [(1, 3), (2, 3), (4, 6), (5, 6)]
+    assert matches[0].elems == ['new', 'york']
+
+
+def test_case_fold():
+    rng = random.Random(5)
+    automaton = make_automaton(['straße', 'äb'], byte_mode=True, case_fold='unicode')
+    text = long_text(rng, 'ÄäBbx ', 9000) + 'STRAßE'
+    assert spans(automaton.iter_matches(text)) == by_end(automaton.get_matches(text, exclude_overlaps=False))
+
+
+def test_max_matches():
+    automaton = make_automaton(['a', 'aa'])
+    text = 'a' * 100
+    assert len(list(automaton.iter_matches(text, max_matches=7))) == 7
+    assert len(list(automaton.iter_matches(text, max_matches=0))) == 0
+    assert len(automaton.get_matches(text, exclude_overlaps=False, max_matches=7)) == 7
+    assert len(automaton.get_matches(text, match_kind='leftmost_longest', max_matches=3)) == 3
+    assert len(automaton.get_matches_array(text, max_matches=5)) <= 5
+    automaton = make_automaton(['a', 'aa'], byte_mode=True)
+    assert len(automaton.get_matches(text, exclude_overlaps=False, max_matches=7)) == 7
+
+
+def test_adversarial():
+    # every position of the text ends a match of every pattern
+    patterns = ['a' * n for n in range(1, 51)]
+    automaton = make_automaton(patterns, byte_mode=True)
+    text = 'a' * 20000
+    matches = automaton.iter_matches(text)
+    first = next(matches)
+    assert (first.start, first.end) == (0, 1)
+    assert sum(1 for _ in itertools.islice(matches, 100000)) == 100000
+    # more leftmost matches than fit in a batch
+    assert sum(1 for _ in automaton.iter_matches(text, match_kind='leftmost_first')) == len(text)
+    assert sum(1 for _ in automaton.iter_matches(text, match_kind='leftmost_longest')) == len(text) // 50
+
+
+def test_no_overlaps():
+    automaton = make_automaton(['a'])
+    with pytest.raises(ValueError):
+        automaton.iter_matches('a', match_kind='no_overlaps')
+
+
+def test_modified_during_iteration():
+    automaton = make_automaton(['a', 'b'])
+    matches = automaton.iter_matches('ab' * 10000)
+    next(matches)
+    automaton.remove('b')
+    with pytest.raises(RuntimeError):
+        list(matches)
@@ -2,6 +2,8 @@
 from __future__ import unicode_literals, print_function, absolute_import
 
 from aca import Automaton
+import itertools
+import pytest
 import sys
 
 names = [('janek', 'nice'), ('jaan', 'nice'), ('jaagup', 'ugly'), ('jaanus', 'nice'), ('janis', 'nice')]
@@ -24,3 +26,69 @@ def test_prefixes():
     prefixes = [''.join(prefix) for prefix in prefixes]
     assert prefixes == ['', 'j', 'ja', 'jaa', 'jaan', 'jaanu', 'jaanus', 'jan', 'jane', 'janek', 'jani', 'janis']
 
+
+
+def test_items_prefix():
+    auto = Automaton()
+    auto.add_all(names)
+    assert [(''.join(k), v) for k, v in auto.items(prefix='jaa')] == [('jaagup', 'ugly'), ('jaan', 'nice'), ('jaanus', 'nice')]
+    assert [''.join(k) for k, v in auto.items(prefix='jaan')] == ['jaan', 'jaanus']
+    assert list(auto.items(prefix='jx')) == []
+    assert [''.join(k) for k, v in auto.prefixes(prefix='jan')] == ['jan', 'jane', 'janek', 'jani', 'janis']
+
+
+def test_limit_offset():
+    auto = Automaton()
+    auto.add_all(names)
+    everything = list(auto.items())
+    for offset in range(7):
+        for limit in range(7):
+            assert list(auto.items(limit=limit, offset=offset)) == everything[offset:offset + limit]
+    assert list(auto.items(prefix='ja', offset=3)) == everything[3:]
+    prefixes = list(auto.prefixes())
+    assert list(auto.prefixes(limit=4, offset=2)) == prefixes[2:6]
+
+
+def test_many():
+    # more patterns than the automaton returns at a time
+    auto = Automaton()
+    words = ['w{:05d}'.format(i) for i in range(3000)]
+    auto.add_all(words)
+    assert [''.join(k) for k, v in auto.items()] == words
+    assert [''.join(k) for k, v in auto.items(prefix='w01')] == words[1000:2000]
+    first = list(itertools.islice(auto.items(prefix='w02', offset=5), 3))
+    assert [''.join(k) for k, v in first] == words[2005:2008]
+
+
+@pytest.mark.parametrize('mapped', [False, True])
+def test_byte_mode(mapped, tmpdir):
+    auto = Automaton(byte_mode=True, case_fold='unicode')
+    auto.add_all(['äpfel', 'äffchen', 'apfel'])
+    if mapped:
+        fnm = str(tmpdir.join('items.aca'))
+        auto.save_mmap(fnm)
+        auto = Automaton()
+        auto.load_mmap(fnm)
+    assert [k for k, v in auto.items(prefix='Äp')] == ['äpfel']
+    # the prefixes ending inside a character are left out
+    assert [k for k, v in auto.prefixes(prefix='Ä', limit=3)] == ['ä', 'äf', 'äff']
+
+
+def test_tokens():
+    auto = Automaton()
+    auto.add(['new', 'york'], 'city')
+    auto.add(['new', 'york', 'times'], 'paper')
+    auto.add(['new', 'delhi'], 'city')
+    assert list(auto.items(prefix=['new', 'york'])) == [(['new', 'york'], 'city'), (['new', 'york', 'times'], 'paper')]
+    assert list(auto.prefixes(prefix=['new'])) == [(['new'], ''), (['new', 'delhi'], 'city'),
+                                                    (['new', 'york'], 'city'), (['new', 'york', 'times'], 'paper')]
+
+
+def test_modified_during_iteration():
+    auto = Automaton()
+    auto.add_all(['w{:05d}'.format(i) for i in range(1000)])
+    items = auto.items()
+    next(items)
+    auto.remove('w00500')
+    with pytest.raises(RuntimeError):
+        list(items)
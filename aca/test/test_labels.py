@@ -0,0 +1,60 @@
+# -*- coding: utf-8 -*-
+from __future__ import unicode_literals, print_function, absolute_import
+
+from aca import Automaton
+from aca.aca_cpp import remove_overlaps
+
+
+def make_automaton():
+    auto = Automaton()
+    auto.add_all([('tom', 'person'), ('tom anderson', 'person'), ('mars', 'planet'),
+                  ('anderson', 'person'), ('venus', 'planet')])
+    return auto
+
+
+def test_shared_labels():
+    auto = make_automaton()
+    text = 'tom anderson flew to mars and venus'
+    matches = auto.get_matches(text)
+    assert [(m.elems, m.label) for m in matches] == [
+        ('tom anderson', 'person'), ('mars', 'planet'), ('venus', 'planet')]
+    # the decoded labels are cached per label id
+    assert matches[1].label is matches[2].label
+
+    # labels survive serialization and compilation
+    copy = Automaton()
+    copy.load_from_string(auto.save_to_string())
+    copy.compile()
+    assert [m.label for m in copy.get_matches(text)] == [m.label for m in matches]
+
+
+def test_changed_value():
+    auto = make_automaton()
+    assert [m.label for m in auto.get_matches('mars')] == ['planet']
+    auto['mars'] = 'god'
+    assert [m.label for m in auto.get_matches('mars')] == ['god']
+    assert auto['venus'] == 'planet'
+
+
+def test_remove_overlaps_keeps_matches():
+    auto = make_automaton()
+    matches = auto.get_matches('tom anderson', exclude_overlaps=False)
+    result = remove_overlaps(matches)
+    assert len(result) == 1
+    assert result[0] is matches[1]
+    assert result[0].elems == 'tom anderson'
+
+
+def test_compact_frees_labels():
+    auto = make_automaton()
+    text = 'tom met anderson on mars'
+    for version in range(1000):
+        auto['mars'] = 'planet {}'.format(version)
+    auto.remove('venus')
+    assert len(auto.labels()) == 1003
+    auto.compact()
+    assert sorted(auto.labels()) == ['', 'person', 'planet 999']
+    assert [m.label for m in auto.get_matches(text)] == ['person', 'person', 'planet 999']
+    auto.compile()
+    auto.compact()
+    assert auto['mars'] == 'planet 999'
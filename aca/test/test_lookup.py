@@ -0,0 +1,84 @@
+# -*- coding: utf-8 -*-
+from __future__ import unicode_literals, print_function, absolute_import
+import random
+from aca import Automaton
+
+
+def random_words(rng, count):
+    return [''.join(rng.choice('abcdeäö') for _ in range(rng.randint(1, 8))) for _ in range(count)]
+
+
+def check_lookups(automaton, words, queries):
+    expected = [(automaton.get(q), automaton.has_pattern(q), automaton.has_prefix(q)) for q in queries]
+    automaton.build_lookup()
+    assert automaton.has_lookup()
+    assert [(automaton.get(q), automaton.has_pattern(q), automaton.has_prefix(q)) for q in queries] == expected
+    for word in words:
+        assert automaton[word] == 'v' + word
+
+
+def test_same_as_tree():
+    rng = random.Random(11)
+    words = random_words(rng, 2000)
+    queries = words + random_words(rng, 2000) + ['', 'x', 'aaaaaaaaaaaaaaaa']
+    for byte_mode in (False, True):
+        automaton = Automaton(byte_mode=byte_mode)
+        for word in words:
+            automaton[word] = 'v' + word
+        check_lookups(automaton, words, queries)
+
+
+def test_tokens():
+    automaton = Automaton()
+    automaton.add(['new', 'york'], 'city')
+    automaton.add(['new', 'york', 'times'], 'paper')
+    automaton.build_lookup()
+    assert automaton[['new', 'york']] == 'city'
+    assert automaton.get(['new']) is None
+    assert automaton.has_prefix(['new'])
+    assert not automaton.has_prefix(['old'])
+    assert not automaton.has_pattern(['new', 'york', 'post'])
+
+
+def test_case_fold():
+    automaton = Automaton(byte_mode=True, case_fold='unicode')
+    automaton['Straße'] = 'street'
+    automaton.build_lookup()
+    assert automaton['STRAßE'] == 'street'
+    assert automaton.has_prefix('STR')
+
+
+def test_modification_drops_lookup():
+    automaton = Automaton()
+    automaton['ab'] = 'x'
+    automaton.build_lookup()
+    automaton['abc'] = 'y'
+    assert not automaton.has_lookup()
+    assert automaton['abc'] == 'y'
+    automaton.build_lookup()
+    del automaton['ab']
+    assert not automaton.has_lookup()
+    assert 'ab' not in automaton
+
+
+def test_mapped(tmpdir):
+    rng = random.Random(12)
+    words = random_words(rng, 500)
+    automaton = Automaton()
+    for word in words:
+        automaton[word] = 'v' + word
+    fnm = str(tmpdir.join('lookup.aca'))
+    automaton.save_mmap(fnm)
+    mapped = Automaton()
+    mapped.load_mmap(fnm)
+    check_lookups(mapped, words, words + random_words(rng, 500))
+
+
+def test_memory():
+    rng = random.Random(13)
+    automaton = Automaton()
+    for word in random_words(rng, 5000):
+        automaton[word] = 'v'
+    automaton.build_lookup()
+    memory = automaton.stats()['memory']
+    assert memory['lookup'] < memory['nodes'] / 2
@@ -0,0 +1,79 @@
+# -*- coding: utf-8 -*-
+from __future__ import unicode_literals, print_function, absolute_import
+
+import ctypes
+import pytest
+from aca import Automaton
+
+# the flags of PyObject_GetBuffer, see the buffer protocol
+PyBUF_SIMPLE = 0
+PyBUF_WRITABLE = 0x0001
+PyBUF_FORMAT = 0x0004
+PyBUF_ND = 0x0008
+PyBUF_STRIDES = 0x0010 | PyBUF_ND
+PyBUF_F_CONTIGUOUS = 0x0040 | PyBUF_STRIDES
+
+
+def make_automaton(byte_mode=False):
+    auto = Automaton(byte_mode=byte_mode)
+    auto.add_all([('he', 'pronoun'), ('she', 'pronoun'), ('hers', 'pronoun'), ('us', 'other')])
+    return auto
+
+
+def test_same_as_get_matches():
+    for byte_mode in [False, True]:
+        auto = make_automaton(byte_mode)
+        for exclude_overlaps in [True, False]:
+            array = auto.get_matches_array('ushers', exclude_overlaps)
+            view = memoryview(array)
+            assert view.shape == (len(array), 3)
+            assert view.format == 'i'
+            assert view.readonly
+            labels = auto.labels()
+            rows = [(start, end, labels[label]) for start, end, label in view.tolist()]
+            expected = [(m.start, m.end, m.label) for m in auto.get_matches('ushers', exclude_overlaps)]
+            assert expected == rows
+
+
+def test_empty():
+    auto = make_automaton()
+    array = auto.get_matches_array('nothing')
+    assert len(array) == 0
+    assert memoryview(array).tolist() == []
+
+
+def test_labels():
+    auto = make_automaton()
+    assert auto.labels() == ['', 'pronoun', 'other']
+
+
+class PyBuffer(ctypes.Structure):
+    _fields_ = [('buf', ctypes.c_void_p), ('obj', ctypes.c_void_p), ('len', ctypes.c_ssize_t),
+                ('itemsize', ctypes.c_ssize_t), ('readonly', ctypes.c_int), ('ndim', ctypes.c_int),
+                ('format', ctypes.c_char_p), ('shape', ctypes.POINTER(ctypes.c_ssize_t)),
+                ('strides', ctypes.POINTER(ctypes.c_ssize_t)), ('suboffsets', ctypes.POINTER(ctypes.c_ssize_t)),
+                ('internal', ctypes.c_void_p)]
+
+
+def get_buffer(obj, flags):
+    get = ctypes.pythonapi.PyObject_GetBuffer
+    get.argtypes = [ctypes.py_object, ctypes.POINTER(PyBuffer), ctypes.c_int]
+    buffer = PyBuffer()
+    get(obj, ctypes.byref(buffer), flags)
+    result = (buffer.readonly, buffer.ndim, bool(buffer.format), bool(buffer.shape), bool(buffer.strides))
+    ctypes.pythonapi.PyBuffer_Release.argtypes = [ctypes.POINTER(PyBuffer)]
+    ctypes.pythonapi.PyBuffer_Release(ctypes.byref(buffer))
+    return result
+
+
+def test_buffer_flags():
+    array = make_automaton().get_matches_array('ushers', False)
+    assert memoryview(array).readonly
+    with pytest.raises(BufferError):
+        get_buffer(array, PyBUF_WRITABLE)
+    with pytest.raises(BufferError):
+        get_buffer(array, PyBUF_F_CONTIGUOUS)
+    # only the parts of the layout that were asked for
+    assert get_buffer(array, PyBUF_SIMPLE) == (1, 1, False, False, False)
+    assert get_buffer(array, PyBUF_ND | PyBUF_FORMAT) == (1, 2, True, True, False)
+    assert get_buffer(array, PyBUF_STRIDES) == (1, 2, False, True, True)
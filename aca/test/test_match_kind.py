@@ -0,0 +1,119 @@
+# -*- coding: utf-8 -*-
+from __future__ import unicode_literals, print_function, absolute_import
+import random
+import pytest
+from aca import Automaton
+
+
+def leftmost(patterns, text, longest):
+    """ Reference implementation, patterns are in the order they were added. """
+    ranks = {}
+    for pattern in patterns:
+        ranks.setdefault(pattern, len(ranks))
+    result = []
+    pos = 0
+    while pos < len(text):
+        for start in range(pos, len(text)):
+            found = [p for p in ranks if text[start:start + len(p)] == p]
+            if found:
+                if longest:
+                    best = max(found, key=len)
+                else:
+                    best = min(found, key=lambda p: ranks[p])
+                result.append((start, start + len(best)))
+                pos = start + len(best)
+                break
+        else:
+            break
+    return result
+
+
+def spans(matches):
+    return [(match.start, match.end) for match in matches]
+
+
+def make_automaton(patterns, **kwargs):
+    automaton = Automaton(**kwargs)
+    for pattern in patterns:
+        automaton.add(pattern, pattern)
+    return automaton
+
+
+def test_leftmost_longest():
+    automaton = make_automaton(['abcd', 'bc', 'b', 'bcde'])
+    matches = automaton.get_matches('abcde', match_kind='leftmost_longest')
+    assert spans(matches) == [(0, 4)]
+    assert [match.label for match in matches] == ['abcd']
+    assert spans(automaton.get_matches('xbcdex', match_kind='leftmost_longest')) == [(1, 5)]
+
+
+def test_leftmost_first():
+    automaton = make_automaton(['samwise', 'sam', 'wise'])
+    assert spans(automaton.get_matches('samwise', match_kind='leftmost_first')) == [(0, 7)]
+    automaton = make_automaton(['sam', 'samwise', 'wise'])
+    matches = automaton.get_matches('samwise', match_kind='leftmost_first')
+    assert spans(matches) == [(0, 3), (3, 7)]
+    assert [match.elems for match in matches] == ['sam', 'wise']
+
+
+def test_readding_keeps_rank():
+    automaton = make_automaton(['ab', 'abc'])
+    automaton.add('ab', 'again')
+    matches = automaton.get_matches('abc', match_kind='leftmost_first')
+    assert spans(matches) == [(0, 2)]
+    assert matches[0].label == 'again'
+
+
+def test_exclude_overlaps_kinds():
+    automaton = make_automaton(['he', 'she', 'hers'])
+    text = 'ushers'
+    assert automaton.get_matches(text, match_kind='all') == automaton.get_matches(text, exclude_overlaps=False)
+    assert automaton.get_matches(text, match_kind='no_overlaps') == automaton.get_matches(text)
+
+
+def test_unknown_kind():
+    automaton = make_automaton(['he'])
+    with pytest.raises(ValueError):
+        automaton.get_matches('he', match_kind='shortest')
+
+
+@pytest.mark.parametrize('byte_mode', [False, True])
+def test_random_against_reference(byte_mode):
+    rnd = random.Random(18)
+    for _ in range(200):
+        patterns = [''.join(rnd.choice('abc') for _ in range(rnd.randint(1, 4))) for _ in range(rnd.randint(1, 8))]
+        text = ''.join(rnd.choice('abc') for _ in range(rnd.randint(0, 30)))
+        automaton = make_automaton(patterns, byte_mode=byte_mode)
+        for longest, kind in ((True, 'leftmost_longest'), (False, 'leftmost_first')):
+            expected = leftmost(patterns, text, longest)
+            assert spans(automaton.get_matches(text, match_kind=kind)) == expected
+            automaton.compile()
+            assert spans(automaton.get_matches(text, match_kind=kind)) == expected
+            automaton.add('x')
+
+
+def test_ranks_are_kept(tmpdir):
+    patterns = ['sam', 'samwise', 'wise']
+    automaton = Automaton()
+    automaton.build([(pattern, pattern) for pattern in patterns])
+    expected = [(0, 3), (3, 7)]
+    assert spans(automaton.get_matches('samwise', match_kind='leftmost_first')) == expected
+
+    copy = Automaton()
+    copy.load_from_string(automaton.save_to_string())
+    assert spans(copy.get_matches('samwise', match_kind='leftmost_first')) == expected
+
+    fnm = str(tmpdir.join('ranks.aca'))
+    automaton.save_mmap(fnm)
+    mapped = Automaton()
+    mapped.load_mmap(fnm)
+    assert spans(mapped.get_matches('samwise', match_kind='leftmost_first')) == expected
+
+
+def test_array_and_batch():
+    automaton = make_automaton(['abcd', 'bc'])
+    texts = ['abcd', 'xbcx']
+    results = automaton.get_matches_batch(texts, match_kind='leftmost_longest')
+    assert [spans(matches) for matches in results] == [[(0, 4)], [(1, 3)]]
+    array = automaton.get_matches_array('abcd', match_kind='leftmost_longest')
+    assert [tuple(row[:2]) for row in memoryview(array).tolist()] == [(0, 4)]
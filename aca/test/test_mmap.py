@@ -0,0 +1,76 @@
+# -*- coding: utf-8 -*-
+from __future__ import unicode_literals, print_function, absolute_import
+
+import os
+import pytest
+from tempfile import TemporaryDirectory
+from aca import Automaton
+
+NAMES = [
+    (['Yuri', 'Artyukhin'], 'developer'),
+    (['Tom', 'Anderson', 'Jr'], 'designer'),
+    (['Tom', 'Anderson'], 'manager'),
+    (['Jüri', 'Õun'], 'tester'),
+]
+TEXT = 'Tom Anderson Jr and Yuri Artyukhin and Jüri Õun work on my project with Tom Anderson'.split()
+
+
+def make_automaton():
+    auto = Automaton()
+    auto.add_all(NAMES)
+    auto.add_all(['he', 'she', 'his', 'hers'])
+    return auto
+
+
+def test_mmap_round_trip():
+    auto = make_automaton()
+    with TemporaryDirectory() as tmpdir:
+        fnm = os.path.join(tmpdir, 'test.acadfa')
+        auto.save_mmap(fnm)
+        auto2 = Automaton()
+        auto2.load_mmap(fnm)
+        assert auto2.is_read_only()
+
+        for exclude_overlaps in [True, False]:
+            assert auto.get_matches(TEXT, exclude_overlaps) == auto2.get_matches(TEXT, exclude_overlaps)
+            assert auto.get_matches('ushers', exclude_overlaps) == auto2.get_matches('ushers', exclude_overlaps)
+        assert list(auto.items()) == list(auto2.items())
+        assert list(auto.prefixes()) == list(auto2.prefixes())
+        assert auto2[['Jüri', 'Õun']] == 'tester'
+        assert auto2.has_prefix(['Tom'])
+        assert not auto2.has_pattern(['Tom'])
+        assert auto2.get(['Yuri'], 'missing') == 'missing'
+        assert auto.str() == auto2.str()
+
+        # a mapped automaton can be saved again
+        fnm2 = os.path.join(tmpdir, 'test2.acadfa')
+        auto2.save_mmap(fnm2)
+        auto3 = Automaton()
+        auto3.load_mmap(fnm2)
+        assert list(auto.items()) == list(auto3.items())
+        del auto2, auto3
+
+
+def test_mmap_is_read_only():
+    auto = make_automaton()
+    with TemporaryDirectory() as tmpdir:
+        fnm = os.path.join(tmpdir, 'test.acadfa')
+        auto.save_mmap(fnm)
+        auto2 = Automaton()
+        auto2.load_mmap(fnm)
+        with pytest.raises(RuntimeError):
+            auto2.add('him')
+        with pytest.raises(RuntimeError):
+            auto2.save_to_string()
+        del auto2
+
+
+def test_mmap_invalid_file():
+    auto = make_automaton()
+    with TemporaryDirectory() as tmpdir:
+        fnm = os.path.join(tmpdir, 'test.aca')
+        auto.save_to_file(fnm)
+        with pytest.raises(RuntimeError):
+            Automaton().load_mmap(fnm)
+        with pytest.raises(RuntimeError):
+            Automaton().load_mmap(os.path.join(tmpdir, 'missing.acadfa'))
@@ -0,0 +1,114 @@
+# -*- coding: utf-8 -*-
+from __future__ import unicode_literals, print_function, absolute_import
+import random
+from aca import Automaton
+
+
+KERNELS = {'none', 'scalar', 'memchr', 'sse2', 'ssse3', 'avx2'}
+
+
+def all_matches(patterns, text):
+    """ Reference implementation of the overlapping matches. """
+    return sorted((start, start + len(p)) for p in set(patterns) for start in range(len(text))
+                  if text[start:start + len(p)] == p)
+
+
+def spans(matches):
+    return sorted((match.start, match.end) for match in matches)
+
+
+def random_text(rng, alphabet, size):
+    return ''.join(rng.choice(alphabet) for _ in range(size))
+
+
+def check(patterns, texts, **kwargs):
+    automaton = Automaton(**kwargs)
+    automaton.add_all(patterns)
+    for compiled in (False, True):
+        if compiled:
+            automaton.compile()
+        for text in texts:
+            assert spans(automaton.get_matches(text, exclude_overlaps=False)) == all_matches(patterns, text)
+    return automaton
+
+
+def test_kernels():
+    rng = random.Random(1)
+    # the sparse texts are long runs of bytes that can not start a match
+    texts = ['x' * n + 'ab' + 'y' * m + 'cab' for n in (0, 1, 15, 16, 17, 31, 32, 33, 100) for m in (0, 40)]
+    texts.append('')
+    texts.append('abc' * 50)
+    texts.extend(random_text(rng, 'abcdxyz', 200) for _ in range(20))
+    for patterns in (['ab'], ['ab', 'ca'], ['ab', 'ca', 'bc'], ['ab', 'ca', 'bc', 'dab', 'z']):
+        automaton = check(patterns, texts, byte_mode=True)
+        assert automaton.stats()['prefilter'] in KERNELS
+        check(patterns, texts)
+
+
+def test_kernel_choice():
+    automaton = Automaton(byte_mode=True)
+    automaton.add('a')
+    automaton.update_automaton()
+    assert automaton.stats()['prefilter'] == 'memchr'
+    automaton.add_all(['b', 'c', 'd'])
+    assert automaton.stats()['prefilter'] in {'scalar', 'ssse3', 'avx2'}
+    automaton = Automaton()
+    automaton.add('a')
+    automaton.update_automaton()
+    assert automaton.stats()['prefilter'] == 'scalar'
+
+
+def test_high_bytes():
+    patterns = ['été', 'abÿ', '€']
+    texts = ['summer été costs 5€ ' * 3, 'x' * 40 + 'abÿ', 'tete']
+    automaton = Automaton(byte_mode=True)
+    automaton.add_all(patterns)
+    for text in texts:
+        expected = len(all_matches(patterns, text))
+        assert len(automaton.get_matches(text, exclude_overlaps=False)) == expected
+
+
+def test_case_fold():
+    text = 'x' * 40 + 'HeLLo' + 'y' * 20 + 'hello'
+    for fold in ('ascii', 'unicode'):
+        automaton = Automaton(byte_mode=True, case_fold=fold)
+        automaton.add('hello')
+        assert spans(automaton.get_matches(text)) == [(40, 45), (65, 70)]
+    automaton = Automaton(byte_mode=True, case_fold='unicode')
+    automaton.add('är')
+    assert spans(automaton.get_matches('x' * 33 + 'ÄR')) == [(33, 35)]
+
+
+def test_leftmost_and_stream():
+    automaton = Automaton(byte_mode=True)
+    automaton.add_all(['abc', 'bcd', 'ab'])
+    text = '-' * 50 + 'abcd' + '-' * 50 + 'ab'
+    assert spans(automaton.get_matches(text, match_kind='leftmost_longest')) == [(50, 53), (104, 106)]
+    matcher = automaton.matcher()
+    found = []
+    for i in range(0, len(text), 7):
+        found.extend(matcher.feed(text[i:i + 7]))
+    assert spans(found) == all_matches(['abc', 'bcd', 'ab'], text)
+
+
+def test_incremental_add():
+    automaton = Automaton(byte_mode=True)
+    automaton.add('ab')
+    assert len(automaton.get_matches('x' * 40 + 'qr')) == 0
+    # a new first byte after the automaton has been updated
+    automaton.add('qr')
+    assert spans(automaton.get_matches('x' * 40 + 'qr')) == [(40, 42)]
+    automaton.remove('ab')
+    assert spans(automaton.get_matches('ab' * 20 + 'qr')) == [(40, 42)]
+
+
+def test_mapped(tmpdir):
+    automaton = Automaton(byte_mode=True)
+    automaton.add_all(['needle', 'pin'])
+    fnm = str(tmpdir.join('prefilter.aca'))
+    automaton.save_mmap(fnm)
+    mapped = Automaton()
+    mapped.load_mmap(fnm)
+    assert mapped.stats()['prefilter'] == automaton.stats()['prefilter']
+    text = 'hay' * 100 + 'needle' + 'hay' * 10 + 'pin'
+    assert spans(mapped.get_matches(text)) == spans(automaton.get_matches(text))
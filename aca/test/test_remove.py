@@ -0,0 +1,74 @@
+# -*- coding: utf-8 -*-
+from __future__ import unicode_literals, print_function, absolute_import
+
+import random
+import pytest
+from aca import Automaton
+
+
+def test_remove_prunes_nodes():
+    auto = Automaton()
+    auto.add_all(['acid', 'acidic', 'elegant', 'electrify'])
+    del auto['electrify']
+    assert not auto.has_prefix('elec')
+    assert auto.has_prefix('ele')
+    del auto['acid']
+    assert auto.has_prefix('acid')
+    assert not auto.has_pattern('acid')
+    assert 'acidic' in auto
+    assert not auto.remove('acid')
+    assert not auto.remove('missing')
+    with pytest.raises(KeyError):
+        del auto['acid']
+    assert [''.join(k) for k, v in auto.items()] == ['acidic', 'elegant']
+
+
+def test_compact():
+    auto = Automaton()
+    auto.add_all(['he', 'she', 'his', 'hers'])
+    auto.get_matches('ushers')
+    size = len(auto.save_to_string())
+    del auto['hers']
+    del auto['his']
+    auto.compact()
+    assert len(auto.save_to_string()) < size
+    assert [m.elems for m in auto.get_matches('ushers his', exclude_overlaps=False)] == ['she', 'he']
+    del auto['she']
+    auto.compile()
+    auto.compact()
+    assert auto.is_compiled()
+    assert [m.elems for m in auto.get_matches('ushers', exclude_overlaps=False)] == ['he']
+
+
+def test_same_as_building_again():
+    rnd = random.Random(3)
+    for _ in range(200):
+        auto = Automaton()
+        words = set()
+        for _ in range(rnd.randint(1, 20)):
+            word = ''.join(rnd.choice('abc') for _ in range(rnd.randint(1, 5)))
+            if word in words and rnd.random() < 0.7:
+                del auto[word]
+                words.remove(word)
+            else:
+                auto.add(word)
+                words.add(word)
+            if rnd.random() < 0.5:
+                auto.update_automaton()
+            if rnd.random() < 0.2:
+                auto.compact()
+            expected = Automaton()
+            expected.add_all(sorted(words))
+            text = ''.join(rnd.choice('abc') for _ in range(20))
+            assert expected.get_matches(text, exclude_overlaps=False) == auto.get_matches(text, exclude_overlaps=False)
+            assert list(expected.prefixes()) == list(auto.prefixes())
+
+
+def test_removed_matcher_state():
+    auto = Automaton()
+    auto.add_all(['abc', 'b'])
+    matcher = auto.matcher()
+    matcher.feed('ab')
+    del auto['abc']
+    with pytest.raises(RuntimeError):
+        matcher.feed('c')
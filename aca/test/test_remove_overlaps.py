@@ -41,3 +41,43 @@ def test_one_large_segment():
     test_input = matches([(1, 2), (2, 3), (4, 5), (4, 8), (5, 6), (6, 9), (7, 9), (2, 7), (1, 10)])
     expected = matches([(1, 10)])
     assert expected == remove_overlaps(test_input)
+
+
+def reference_remove_overlaps(spans):
+    # the quadratic dynamic programming that remove_overlaps has to agree with
+    scores, prev = [], []
+    highscore, highpos = 0, -1
+    for i, (start, end) in enumerate(spans):
+        bestscore, bestprev = end - start, -1
+        for j in range(i - 1, -1, -1):
+            if spans[j][1] <= start and scores[j] + end - start >= bestscore:
+                bestscore, bestprev = scores[j] + end - start, j
+        scores.append(bestscore)
+        prev.append(bestprev)
+        if highpos == -1 or bestscore >= highscore:
+            highscore, highpos = bestscore, i
+    keep = []
+    while highpos != -1:
+        keep.append(highpos)
+        highpos = prev[highpos]
+    return [spans[i] for i in reversed(keep)]
+
+
+def test_same_as_reference():
+    import random
+    rnd = random.Random(42)
+    for _ in range(2000):
+        spans = []
+        for _ in range(rnd.randint(1, 10)):
+            start = rnd.randint(0, 15)
+            spans.append((start, start + rnd.randint(1, 4)))
+        if rnd.random() < 0.5:
+            spans.sort()
+        result = remove_overlaps(matches(spans))
+        assert reference_remove_overlaps(spans) == [(m.start, m.end) for m in result]
+
+
+def test_many_spans():
+    test_input = matches([(i, i + 1 + i % 7) for i in range(100000)])
+    result = remove_overlaps(test_input)
+    assert all(a.end <= b.start for a, b in zip(result, result[1:]))
@@ -0,0 +1,84 @@
+from aca import Automaton
+
+
+def make_automaton():
+    automaton = Automaton()
+    automaton.add(['he'], 'PRONOUN')
+    automaton.add(['she'], 'PRONOUN')
+    automaton.add(['his'])
+    automaton.add(['hers'])
+    return automaton
+
+
+def test_structure():
+    automaton = Automaton()
+    automaton.add('he')
+    automaton.add('she')
+    automaton.add('his')
+    automaton.add('hers')
+    automaton.update_automaton()
+    stats = automaton.stats()
+    # root, h, he, her, hers, hi, his, s, sh, she
+    assert stats['nodes'] == 10
+    assert stats['patterns'] == 4
+    assert stats['max_depth'] == 4
+    # every pattern reports itself, she also reports he
+    assert stats['output_links'] == 5
+    assert stats['fanout'] == {0: 3, 1: 5, 2: 2}
+    assert sum(stats['fanout'].values()) == stats['nodes']
+    assert set(stats['memory']) == {'nodes', 'fail_links', 'symbols', 'labels'}
+    assert all(size > 0 for size in stats['memory'].values())
+
+
+def test_removed_nodes_are_not_counted():
+    automaton = Automaton()
+    automaton.add('he')
+    automaton.add('hers')
+    automaton.remove('hers')
+    stats = automaton.stats()
+    assert stats['nodes'] == 3
+    assert stats['patterns'] == 1
+    assert stats['max_depth'] == 2
+
+
+def test_compiled_and_mapped(tmpdir):
+    automaton = make_automaton()
+    automaton.update_automaton()
+    tree_stats = automaton.stats()
+    automaton.compile()
+    compiled_stats = automaton.stats()
+    assert 'dfa' in compiled_stats['memory']
+    for key in ('nodes', 'patterns', 'max_depth', 'output_links', 'fanout'):
+        assert compiled_stats[key] == tree_stats[key]
+
+    fnm = str(tmpdir.join('stats.aca'))
+    automaton.save_mmap(fnm)
+    mapped = Automaton()
+    mapped.load_mmap(fnm)
+    mapped_stats = mapped.stats()
+    assert set(mapped_stats['memory']) == {'dfa'}
+    for key in ('nodes', 'patterns', 'max_depth', 'output_links', 'fanout'):
+        assert mapped_stats[key] == tree_stats[key]
+
+
+def test_counters():
+    automaton = Automaton()
+    automaton.add('he')
+    automaton.add('she')
+    automaton.add('hers')
+    automaton.reset_counters()
+    matches = automaton.get_matches('ushers', exclude_overlaps=True)
+    counters = automaton.stats()['counters']
+    if not counters:
+        return  # built without ACA_STATS
+    assert counters['rebuilds'] == 1
+    assert counters['transitions'] + counters['skipped'] == len('ushers')
+    assert counters['matches'] == 3
+    assert counters['overlaps_removed'] == 3 - len(matches)
+    assert counters['fail_links'] > 0
+
+    automaton.reset_counters()
+    automaton.get_matches('ushers')
+    counters = automaton.stats()['counters']
+    assert counters['rebuilds'] == 0
+    assert counters['transitions'] + counters['skipped'] == len('ushers')
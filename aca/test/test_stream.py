@@ -0,0 +1,49 @@
+# -*- coding: utf-8 -*-
+from __future__ import unicode_literals, print_function, absolute_import
+
+import pytest
+from aca import Automaton, Match
+
+
+def sort_matches(matches):
+    return sorted(matches, key=lambda m: (m.start, m.end))
+
+
+def test_feed_straddling_chunks():
+    auto = Automaton()
+    auto.add_all(['he', 'she', 'his', 'hers'])
+    matcher = auto.matcher()
+    assert [] == matcher.feed('us')
+    assert [Match(1, 4, 'Y'), Match(2, 4, 'Y')] == matcher.feed('he')
+    assert [Match(2, 6, 'Y')] == matcher.feed('rs')
+    assert matcher.offset == 6
+
+    matcher.reset()
+    assert matcher.offset == 0
+    assert [Match(0, 2, 'Y')] == matcher.feed('he')
+
+
+def test_stream_matches_equal_get_matches():
+    auto = Automaton()
+    auto.add(['Tom', 'Anderson'], 'manager')
+    auto.add(['Tom', 'Anderson', 'Jr'], 'designer')
+    auto.add(['Yuri', 'Artyukhin'], 'developer')
+    text = 'Tom Anderson Jr and Yuri Artyukhin work on my project with Tom Anderson'.split()
+    expected = auto.get_matches(text, exclude_overlaps=False)
+    for chunk_size in [1, 2, 3, 5, len(text)]:
+        chunks = [text[i:i + chunk_size] for i in range(0, len(text), chunk_size)]
+        assert expected == sort_matches(auto.stream_matches(chunks))
+    auto.compile()
+    assert expected == sort_matches(auto.stream_matches([text[:1], text[1:4], text[4:]]))
+
+
+def test_replaced_automaton():
+    auto = Automaton()
+    auto.add('he')
+    matcher = auto.matcher()
+    matcher.feed('h')
+    auto.load_from_string(auto.save_to_string())
+    with pytest.raises(RuntimeError):
+        matcher.feed('e')
+    matcher.reset()
+    assert [Match(0, 2, 'Y')] == matcher.feed('he')
@@ -0,0 +1,29 @@
+# -*- coding: utf-8 -*-
+from __future__ import unicode_literals, print_function, absolute_import
+
+from aca import Automaton, Match
+
+
+def test_encode_symbols():
+    auto = Automaton()
+    auto.add(['Tom', 'Anderson'])
+    auto.add(['Anderson', 'Jr'])
+    symbols = auto.encode_symbols(['Anderson', 'Tom', 'Smith', 'Jr', 'Anderson'])
+    assert symbols[0] == symbols[4]
+    assert len(set(symbols)) == 4
+    # all unknown tokens share the same id
+    assert auto.encode_symbols(['Smith'])[0] == auto.encode_symbols(['Jones'])[0]
+
+
+def test_get_matches_symbols():
+    auto = Automaton()
+    auto.add(['Tom', 'Anderson'], 'manager')
+    auto.add(['Tom', 'Anderson', 'Jr'], 'designer')
+    auto.add(['Yuri', 'Artyukhin'], 'developer')
+    text = 'Tom Anderson Jr and Yuri Artyukhin work on my project'.split()
+    symbols = auto.encode_symbols(text)
+    for exclude_overlaps in [True, False]:
+        expected = auto.get_matches(text, exclude_overlaps=exclude_overlaps)
+        actual = auto.get_matches_symbols(symbols, exclude_overlaps=exclude_overlaps)
+        assert expected == actual
+    assert [Match(0, 3, 'designer'), Match(4, 6, 'developer')] == auto.get_matches_symbols(symbols)
@@ -0,0 +1,505 @@
+// Benchmarks of the automaton on seeded synthetic dictionaries and texts.
+//
+// Every benchmark is run repeatedly until it has taken at least --min-time
+// seconds, the reported time is per iteration. Build with bench/make.sh and run
+//     bench/bench.exe [--filter substring] [--scale factor] [--min-time seconds] [--seed seed]
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <malloc.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include "all.h"
+
+using namespace aca;
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// MEASUREMENTS
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+typedef std::chrono::steady_clock Clock;
+
+static double seconds_since(const Clock::time_point& start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// bytes in use by the heap, or the resident set size where glibc cannot tell.
+// Freed memory is reused, so the resident set only grows with the peak.
+static size_t memory_in_use() {
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+    return mallinfo2().uordblks + mallinfo2().hblkhd;
+#else
+    std::ifstream statm("/proc/self/statm");
+    size_t pages = 0, resident = 0;
+    statm >> pages >> resident;
+    return resident * sysconf(_SC_PAGESIZE);
+#endif
+}
+
+static size_t peak_rss() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return static_cast<size_t>(usage.ru_maxrss) * 1024;
+}
+
+struct Counter {
+    std::string name;
+    double value;
+};
+
+struct Options {
+    std::string filter;
+    double scale = 1.0;
+    double min_time = 0.5;
+    unsigned seed = 42;
+};
+
+class Runner {
+private:
+    Options options;
+public:
+    Runner(const Options& options) : options(options) {
+        std::printf("%-44s %14s %12s  %s\n", "Benchmark", "Time/iter", "Iterations", "Counters");
+        std::printf("%s\n", std::string(108, '-').c_str());
+    }
+
+    const Options& get_options() const { return options; }
+
+    bool selected(const std::string& name) const {
+        return options.filter.empty() || name.find(options.filter) != std::string::npos;
+    }
+
+    // run iteration() until min_time has passed, iteration returns the seconds it wants to be timed,
+    // so that it can leave out its own setup. counters get the number of iterations and the total time.
+    void run(const std::string& name, std::function<double()> iteration,
+             std::function<std::vector<Counter>(size_t, double)> counters) {
+        if (!selected(name)) {
+            return;
+        }
+        size_t iterations = 0;
+        double timed = 0;
+        const Clock::time_point start = Clock::now();
+        do {
+            timed += iteration();
+            ++iterations;
+        } while (seconds_since(start) < options.min_time);
+        std::printf("%-44s %11.3f ms %12zu ", name.c_str(), timed / iterations * 1000, iterations);
+        for (const Counter& counter : counters(iterations, timed)) {
+            std::printf(" %s=%s", counter.name.c_str(), human(counter.value).c_str());
+        }
+        std::printf("\n");
+        std::fflush(stdout);
+    }
+
+    static std::string human(const double value) {
+        const char* units[] = {"", "k", "M", "G", "T"};
+        double scaled = value;
+        size_t unit = 0;
+        while (std::fabs(scaled) >= 1000 && unit < 4) {
+            scaled /= 1000;
+            ++unit;
+        }
+        char buffer[32];
+        std::snprintf(buffer, sizeof(buffer), "%.4g%s", scaled, units[unit]);
+        return buffer;
+    }
+};
+
+static std::function<std::vector<Counter>(size_t, double)> rate(const std::string& name, const double per_iteration) {
+    return [=](size_t iterations, double seconds) {
+        return std::vector<Counter>{{name, per_iteration * iterations / seconds}};
+    };
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// SYNTHETIC DATA
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// samples ranks 0..n-1 with probability proportional to 1/(rank+1)^s
+class Zipf {
+private:
+    std::vector<double> cumulative;
+public:
+    Zipf(const size_t n, const double s) : cumulative(n) {
+        double total = 0;
+        for (size_t i=0 ; i<n ; ++i) {
+            total += 1.0 / std::pow(i + 1, s);
+            cumulative[i] = total;
+        }
+    }
+
+    size_t operator()(std::mt19937& rng) const {
+        std::uniform_real_distribution<double> uniform(0, cumulative.back());
+        return std::lower_bound(cumulative.begin(), cumulative.end(), uniform(rng)) - cumulative.begin();
+    }
+};
+
+struct Dataset {
+    std::string name;
+    bool byte_mode;
+    std::vector<StringVector> patterns;
+    StringVector text;
+    // the text in one piece for byte mode
+    std::string bytes;
+};
+
+static std::string random_word(std::mt19937& rng, const Zipf& letters, const size_t min_length, const size_t max_length) {
+    std::uniform_int_distribution<size_t> length(min_length, max_length);
+    std::string word(length(rng), ' ');
+    for (char& c : word) {
+        c = static_cast<char>('a' + letters(rng));
+    }
+    return word;
+}
+
+static StringVector vocabulary(std::mt19937& rng, const size_t size) {
+    const Zipf letters(26, 0.8);
+    StringVector words;
+    words.reserve(size);
+    for (size_t i=0 ; i<size ; ++i) {
+        words.push_back(random_word(rng, letters, 2, 9) + std::to_string(i % 10));
+    }
+    return words;
+}
+
+// a text of Zipf distributed words, every 20th position starts a pattern of the dictionary
+static StringVector token_text(std::mt19937& rng, const StringVector& words, const Zipf& zipf,
+                               const std::vector<StringVector>& patterns, const size_t size) {
+    StringVector text;
+    text.reserve(size);
+    std::uniform_int_distribution<size_t> pick(0, patterns.size() - 1);
+    while (text.size() < size) {
+        if (rng() % 20 == 0) {
+            const StringVector& pattern = patterns[pick(rng)];
+            text.insert(text.end(), pattern.begin(), pattern.end());
+        } else {
+            text.push_back(words[zipf(rng)]);
+        }
+    }
+    text.resize(size);
+    return text;
+}
+
+// patterns of 1-4 Zipf distributed words, like names and terms
+static Dataset zipf_dataset(std::mt19937& rng, const double scale) {
+    Dataset data;
+    data.name = "zipf";
+    data.byte_mode = false;
+    const StringVector words = vocabulary(rng, 50000 * scale);
+    const Zipf zipf(words.size(), 1.1);
+    std::uniform_int_distribution<size_t> length(1, 4);
+    data.patterns.resize(100000 * scale);
+    for (StringVector& pattern : data.patterns) {
+        for (size_t i=length(rng) ; i>0 ; --i) {
+            pattern.push_back(words[zipf(rng)]);
+        }
+    }
+    data.text = token_text(rng, words, zipf, data.patterns, 1000000 * scale);
+    return data;
+}
+
+// chains of patterns that are prefixes of each other, many of them also suffixes of others
+static Dataset nested_dataset(std::mt19937& rng, const double scale) {
+    Dataset data;
+    data.name = "nested";
+    data.byte_mode = false;
+    const StringVector words = vocabulary(rng, 200);
+    const Zipf zipf(words.size(), 1.0);
+    std::uniform_int_distribution<size_t> length(2, 12);
+    while (data.patterns.size() < 100000 * scale) {
+        StringVector chain;
+        for (size_t i=length(rng) ; i>0 ; --i) {
+            chain.push_back(words[zipf(rng)]);
+            data.patterns.push_back(chain);
+        }
+    }
+    data.text = token_text(rng, words, zipf, data.patterns, 1000000 * scale);
+    return data;
+}
+
+// words matched character by character in byte mode
+static Dataset char_dataset(std::mt19937& rng, const double scale) {
+    Dataset data;
+    data.name = "chars";
+    data.byte_mode = true;
+    const Zipf letters(26, 0.8);
+    data.patterns.resize(100000 * scale);
+    for (StringVector& pattern : data.patterns) {
+        for (char c : random_word(rng, letters, 3, 12)) {
+            pattern.push_back(std::string(1, c));
+        }
+    }
+    std::uniform_int_distribution<size_t> pick(0, data.patterns.size() - 1);
+    while (data.bytes.size() < 4000000 * scale) {
+        if (rng() % 10 == 0) {
+            for (const std::string& c : data.patterns[pick(rng)]) {
+                data.bytes += c;
+            }
+        } else {
+            data.bytes += random_word(rng, letters, 1, 10);
+        }
+        data.bytes += ' ';
+    }
+    for (char c : data.bytes) {
+        data.text.push_back(std::string(1, c));
+    }
+    return data;
+}
+
+// tags that start with rare bytes in a text with few matches, the prefilter skips most of it
+static Dataset sparse_dataset(std::mt19937& rng, const double scale) {
+    Dataset data;
+    data.name = "sparse";
+    data.byte_mode = true;
+    const Zipf letters(26, 0.8);
+    data.patterns.resize(10000 * scale);
+    for (StringVector& pattern : data.patterns) {
+        pattern.push_back(rng() % 2 ? "#" : "@");
+        for (char c : random_word(rng, letters, 3, 12)) {
+            pattern.push_back(std::string(1, c));
+        }
+    }
+    std::uniform_int_distribution<size_t> pick(0, data.patterns.size() - 1);
+    while (data.bytes.size() < 4000000 * scale) {
+        if (rng() % 1000 == 0) {
+            for (const std::string& c : data.patterns[pick(rng)]) {
+                data.bytes += c;
+            }
+        } else {
+            data.bytes += random_word(rng, letters, 1, 10);
+        }
+        data.bytes += ' ';
+    }
+    for (char c : data.bytes) {
+        data.text.push_back(std::string(1, c));
+    }
+    return data;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// BENCHMARKS
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static CppAutomaton* build(const Dataset& data) {
+    CppAutomaton* automaton = new CppAutomaton(data.byte_mode);
+    for (const StringVector& pattern : data.patterns) {
+        automaton->add(pattern, "Y");
+    }
+    return automaton;
+}
+
+static void run_dataset(Runner& runner, const Dataset& data) {
+    const std::string prefix = data.name + "/";
+    const double npatterns = data.patterns.size();
+    const double ntokens = data.text.size();
+
+    runner.run(prefix + "add", [&]() {
+        const Clock::time_point start = Clock::now();
+        std::unique_ptr<CppAutomaton> automaton(build(data));
+        return seconds_since(start);
+    }, rate("patterns/s", npatterns));
+
+    runner.run(prefix + "update_automaton", [&]() {
+        std::unique_ptr<CppAutomaton> automaton(build(data));
+        const Clock::time_point start = Clock::now();
+        automaton->update_automaton();
+        return seconds_since(start);
+    }, rate("patterns/s", npatterns));
+
+    // memory of one automaton, before and after compiling it
+    const size_t in_use = memory_in_use();
+    std::unique_ptr<CppAutomaton> automaton(build(data));
+    automaton->update_automaton();
+    const double nnodes = automaton->num_nodes();
+    const double tree_bytes = memory_in_use() - in_use;
+    automaton->compile();
+    const double compiled_bytes = memory_in_use() - in_use - tree_bytes;
+    automaton.reset(build(data));
+    automaton->update_automaton();
+    if (runner.selected(prefix + "memory")) {
+        std::printf("%-44s %14s %12s  nodes=%s bytes/node=%s compiled_bytes/node=%s\n", (prefix + "memory").c_str(),
+                    "", "", Runner::human(nnodes).c_str(), Runner::human(tree_bytes / nnodes).c_str(),
+                    Runner::human(compiled_bytes / nnodes).c_str());
+    }
+
+    const SymbolVector symbols = automaton->encode_symbols(data.text);
+    for (int exclude_overlaps=0 ; exclude_overlaps<2 ; ++exclude_overlaps) {
+        const std::string suffix = exclude_overlaps ? "/no_overlaps" : "/overlaps";
+        runner.run(prefix + "get_matches" + suffix, [&]() {
+            const Clock::time_point start = Clock::now();
+            automaton->get_matches(data.text, exclude_overlaps);
+            return seconds_since(start);
+        }, rate("tokens/s", ntokens));
+        runner.run(prefix + "get_matches_symbols" + suffix, [&]() {
+            const Clock::time_point start = Clock::now();
+            automaton->get_matches(symbols, exclude_overlaps);
+            return seconds_since(start);
+        }, rate("tokens/s", ntokens));
+    }
+    const std::pair<const char*, CppMatchKind> leftmost_kinds[] = {
+        {"/leftmost_longest", MATCH_LEFTMOST_LONGEST}, {"/leftmost_first", MATCH_LEFTMOST_FIRST}};
+    for (const auto& kind : leftmost_kinds) {
+        runner.run(prefix + "get_matches_symbols" + kind.first, [&]() {
+            const Clock::time_point start = Clock::now();
+            automaton->get_matches(symbols, kind.second);
+            return seconds_since(start);
+        }, rate("tokens/s", ntokens));
+    }
+    runner.run(prefix + "for_each_match_symbols/overlaps", [&]() {
+        const Clock::time_point start = Clock::now();
+        size_t labels = 0;
+        automaton->for_each_match(symbols, MATCH_ALL, [&labels](const int, const int, const LabelId label) {
+            labels += label;
+            return true;
+        });
+        return seconds_since(start);
+    }, rate("tokens/s", ntokens));
+    runner.run(prefix + "count_matches", [&]() {
+        const Clock::time_point start = Clock::now();
+        automaton->count_matches(data.text);
+        return seconds_since(start);
+    }, rate("tokens/s", ntokens));
+
+    const MatchVector raw = automaton->get_matches(symbols, false);
+    runner.run(prefix + "cpp_remove_overlaps", [&]() {
+        const Clock::time_point start = Clock::now();
+        cpp_remove_overlaps(raw);
+        return seconds_since(start);
+    }, rate("matches/s", raw.size()));
+
+    // dictionary lookups of every pattern, in the keyword tree and in the double array
+    runner.run(prefix + "find_label", [&]() {
+        const Clock::time_point start = Clock::now();
+        for (const StringVector& pattern : data.patterns) {
+            automaton->find_label(pattern);
+        }
+        return seconds_since(start);
+    }, rate("lookups/s", npatterns));
+    runner.run(prefix + "build_lookup", [&]() {
+        const Clock::time_point start = Clock::now();
+        automaton->build_lookup();
+        return seconds_since(start);
+    }, rate("patterns/s", npatterns));
+    automaton->build_lookup();
+    runner.run(prefix + "lookup/find_label", [&]() {
+        const Clock::time_point start = Clock::now();
+        for (const StringVector& pattern : data.patterns) {
+            automaton->find_label(pattern);
+        }
+        return seconds_since(start);
+    }, rate("lookups/s", npatterns));
+    if (runner.selected(prefix + "lookup/memory")) {
+        const CppStats stats = automaton->get_stats();
+        std::printf("%-44s %14s %12s  bytes=%s nodes_bytes=%s\n", (prefix + "lookup/memory").c_str(), "", "",
+                    Runner::human(stats.memory.at("lookup")).c_str(), Runner::human(stats.memory.at("nodes")).c_str());
+    }
+
+    const std::string serialized = automaton->serialize();
+    runner.run(prefix + "serialize", [&]() {
+        const Clock::time_point start = Clock::now();
+        automaton->serialize();
+        return seconds_since(start);
+    }, rate("bytes/s", serialized.size()));
+    runner.run(prefix + "deserialize", [&]() {
+        const Clock::time_point start = Clock::now();
+        std::unique_ptr<CppAutomaton> copy(CppAutomaton::deserialize(serialized));
+        return seconds_since(start);
+    }, rate("bytes/s", serialized.size()));
+
+    // a pass over the text for all the dictionaries against a pass for each of them, every pattern
+    // is in a quarter of the dictionaries
+    const DictId ndicts = 16;
+    std::unique_ptr<CppAutomaton> multi(new CppAutomaton(data.byte_mode, CASE_FOLD_NONE, true));
+    std::vector<std::unique_ptr<CppAutomaton>> single;
+    for (DictId dict=0 ; dict<ndicts ; ++dict) {
+        single.emplace_back(new CppAutomaton(data.byte_mode));
+    }
+    for (size_t idx=0 ; idx<data.patterns.size() ; ++idx) {
+        for (DictId dict=idx % 4 ; dict<ndicts ; dict+=4) {
+            multi->add_entry(data.patterns[idx], dict, "Y");
+            single[dict]->add(data.patterns[idx], "Y");
+        }
+    }
+    multi->update_automaton();
+    for (auto& dictionary : single) {
+        dictionary->update_automaton();
+    }
+    const std::vector<bool> active(ndicts, true);
+    IntVector dicts;
+    runner.run(prefix + "dictionaries/get_matches_dicts/no_overlaps", [&]() {
+        const Clock::time_point start = Clock::now();
+        multi->get_matches_dicts(data.text, active, MATCH_NO_OVERLAPS, dicts);
+        return seconds_since(start);
+    }, rate("tokens/s", ntokens));
+    runner.run(prefix + "dictionaries/separate/no_overlaps", [&]() {
+        const Clock::time_point start = Clock::now();
+        for (auto& dictionary : single) {
+            dictionary->get_matches(data.text, true);
+        }
+        return seconds_since(start);
+    }, rate("tokens/s", ntokens));
+    multi.reset();
+    single.clear();
+
+    automaton->compile();
+    runner.run(prefix + "compiled/get_matches_symbols/overlaps", [&]() {
+        const Clock::time_point start = Clock::now();
+        automaton->get_matches(symbols, false);
+        return seconds_since(start);
+    }, rate("tokens/s", ntokens));
+    if (data.byte_mode) {
+        automaton.reset(build(data));
+        automaton->update_automaton();
+        runner.run(prefix + "get_matches_bytes/overlaps", [&]() {
+            const Clock::time_point start = Clock::now();
+            automaton->get_matches_bytes(data.bytes.data(), data.bytes.size(), false);
+            return seconds_since(start);
+        }, rate("bytes/s", data.bytes.size()));
+        automaton->compile();
+        runner.run(prefix + "compiled/get_matches_bytes/overlaps", [&]() {
+            const Clock::time_point start = Clock::now();
+            automaton->get_matches_bytes(data.bytes.data(), data.bytes.size(), false);
+            return seconds_since(start);
+        }, rate("bytes/s", data.bytes.size()));
+    }
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    for (int i=1 ; i<argc ; ++i) {
+        const std::string arg = argv[i];
+        if (i + 1 < argc && arg == "--filter") {
+            options.filter = argv[++i];
+        } else if (i + 1 < argc && arg == "--scale") {
+            options.scale = std::atof(argv[++i]);
+        } else if (i + 1 < argc && arg == "--min-time") {
+            options.min_time = std::atof(argv[++i]);
+        } else if (i + 1 < argc && arg == "--seed") {
+            options.seed = std::atoi(argv[++i]);
+        } else {
+            std::cerr << "usage: " << argv[0] << " [--filter substring] [--scale factor] [--min-time seconds] [--seed seed]\n";
+            return 1;
+        }
+    }
+    Runner runner(options);
+    typedef Dataset (*Generator)(std::mt19937&, const double);
+    const Generator generators[] = {zipf_dataset, nested_dataset, char_dataset, sparse_dataset};
+    for (Generator generator : generators) {
+        // every dataset gets its own generator, so that its data does not depend on the filter
+        std::mt19937 rng(options.seed);
+        run_dataset(runner, generator(rng, options.scale));
+    }
+    std::printf("peak RSS: %s bytes\n", Runner::human(peak_rss()).c_str());
+    return 0;
+}
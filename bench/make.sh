@@ -0,0 +1 @@
+g++ -O2 -DNDEBUG aca/match.cpp aca/node.cpp aca/symbols.cpp aca/flat.cpp aca/mapped.cpp aca/dfa.cpp aca/casefold.cpp aca/prefilter.cpp aca/doublearray.cpp aca/dictionaries.cpp aca/automaton.cpp bench/bench.cpp -std=c++11 -pthread -I ./aca -o bench/bench.exe
@@ -1 +1 @@
-g++ -ggdb aca/match.cpp aca/node.cpp aca/automaton.cpp debug/test.cpp -std=c++11 -I ./aca -o debug/aca.exe
+g++ -ggdb aca/match.cpp aca/node.cpp aca/symbols.cpp aca/flat.cpp aca/mapped.cpp aca/dfa.cpp aca/casefold.cpp aca/prefilter.cpp aca/doublearray.cpp aca/dictionaries.cpp aca/automaton.cpp debug/test.cpp -std=c++11 -pthread -I ./aca -o debug/aca.exe
@@ -1,5 +1,6 @@
 import setuptools
 import platform
+import os
 import codecs
 from distutils.core import setup, Extension
 from Cython.Build import cythonize
@@ -38,7 +39,7 @@ REQUIREMENTS = [
     'six',
     'pytest']
 
-EXTRA_ARGS = ['-std=c++11']
+EXTRA_ARGS = ['-std=c++11', '-pthread']
 
 osname = platform.system().lower()
 if 'linux' in osname:
@@ -48,12 +49,16 @@ if 'darwin' in osname:
 if 'windows' in osname:
     pass # TODO
 
+# set ACA_STATS=1 to collect the hot path counters returned by Automaton.stats()
+DEFINE_MACROS = [('ACA_STATS', '1')] if os.environ.get('ACA_STATS') else []
+
 EXTENSIONS = [
     Extension('aca.aca_cpp',
               sources=['aca/aca_cpp.pyx'],
               language='c++',
+              define_macros=DEFINE_MACROS,
               extra_compile_args=EXTRA_ARGS,
-              extra_link_args=['-std=c++11'])]
+              extra_link_args=['-std=c++11', '-pthread'])]
 
 setup(
     name=NAME,